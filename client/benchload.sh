@@ -0,0 +1,65 @@
+#!/bin/bash
+#
+# benchload.sh - start a server and put it under load from bots
+#
+# usage: bash benchload.sh map seed players policy keys/s ramp seconds report.json
+#
+# Starts ../server/server on the map with the seed, joins that many bots
+# over ramp seconds, each pressing keys/s keys by the policy (see bot.c),
+# and after the given seconds writes the bots' summary, with the map and
+# seed, to report.json. Used by 'make bench-load' at the top level.
+#
+# Ribhu Hooja, March 2024
+
+if [ $# -ne 8 ]; then
+    echo "usage: $0 map seed players policy keys/s ramp seconds report.json" >&2
+    exit 1
+fi
+map=$1
+seed=$2
+players=$3
+policy=$4
+rate=$5
+ramp=$6
+seconds=$7
+report=$8
+dir=$(dirname "$0")
+
+# start the server, and wait for it to say its port
+portfile=$(mktemp)
+"$dir/../server/server" "$map" "$seed" > "$portfile" 2> /dev/null &
+server=$!
+port=
+for i in $(seq 50); do
+    port=$(grep -o 'serverPort=[0-9]*' "$portfile" | cut -d= -f2)
+    [ -n "$port" ] && break
+    sleep 0.1
+done
+rm -f "$portfile"
+if [ -z "$port" ]; then
+    echo "$0: server did not start" >&2
+    kill $server 2> /dev/null
+    exit 2
+fi
+
+# load it
+botreport=$(mktemp)
+"$dir/bot" -ramp "$ramp" -json "$botreport" localhost "$port" \
+    "$players" "$policy" "$rate" "$seconds" "$seed"
+status=$?
+kill $server 2> /dev/null
+wait $server 2> /dev/null
+
+# and say what was run along with what was seen
+if [ $status -eq 0 ]; then
+    {
+        echo "{"
+        echo "  \"map\": \"$map\","
+        echo "  \"seed\": $seed,"
+        echo "  \"load\": $(sed '2,$s/^/  /' "$botreport")"
+        echo "}"
+    } > "$report"
+    echo "report written to $report"
+fi
+rm -f "$botreport"
+exit $status
@@ -0,0 +1,971 @@
+/*
+ * bot.c - headless players, to put a 'nuggets' server under load
+ *
+ * Each bot joins as a player from a socket of its own (the server tells
+ * players apart by address), keeps track of its map from the DISPLAY or
+ * DELTA messages without drawing anything, and presses keys at a steady
+ * rate, chosen by one of these policies:
+ *   random   any move, at random
+ *   greedy   a step toward the nearest gold it can see, else wander
+ *   a file   the keys in that file, over and over (whitespace ignored)
+ *
+ * usage: ./bot [-ramp seconds] [-json report.json]
+ *              hostname port[,port...] [bots [policy [keys/s [seconds [seed]]]]]
+ *
+ * Bots are shared out among the ports in turn, so one process can load
+ * several servers. A game holds 26 players; the server turns away any
+ * more, and the summary at the end says how many it did. With -ramp the
+ * bots join one by one over that many seconds instead of all at once.
+ *
+ * The summary also gives the latency from each key to the frame (DISPLAY
+ * or DELTA) that answers it, frames a second, and frames lost (gaps in
+ * the DELTA numbers); -json writes it all to a file as well. Keys carry
+ * sequence numbers, and the server echoes one on the first frame the key
+ * causes, which is how its frame is told from frames caused by other
+ * players. A key that causes no frame, such as a step into a wall, is
+ * counted but not timed. The latency of each key is also split into time
+ * in the server and time on the network.
+ *
+ * Ribhu Hooja, March 2024
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include "../support/message.h"
+#include "../support/delta.h"
+
+// the most servers the bots can be shared out among
+#define MAXSERVERS 16
+
+// the most keys of a bot whose send times are remembered
+#define MAXTRACES 64
+
+// defaults for the optional arguments
+static const int defaultBots = 10;
+static const float defaultRate = 10;     // keys a second, for each bot
+static const float defaultSeconds = 10;
+
+// the most time poll waits, so the deadline is noticed
+static const int maxWaitMillis = 100;
+
+// the moves a bot can make, and where each one goes
+static const char moveKeys[] = "hjklyubn";
+static const int moveDx[] = { -1, 0, 0, 1, -1, 1, -1, 1 };
+static const int moveDy[] = { 0, 1, -1, 0, -1, -1, 1, 1 };
+static const int numMoves = 8;
+
+
+/************ policy_t **************/
+/* how bots choose their keys */
+typedef enum policy { policy_random, policy_greedy, policy_script } policy_t;
+
+
+/************ struct options **************/
+/* what the command line asks for */
+typedef struct options {
+  addr_t servers[MAXSERVERS];
+  int numServers;
+  int numBots;
+  policy_t policy;
+  const char* policyName;
+  char* script;       // the keys, if the policy is a file of them
+  float rate;         // keys a second, for each bot
+  float seconds;      // how long to play
+  float ramp;         // how long to take over joining
+  const char* report; // where to write the JSON report; NULL for none
+} options_t;
+
+
+/************ struct bot **************/
+/* all a bot knows of its game */
+typedef struct bot {
+  int socket;         // its own, so the server sees a different address
+  addr_t server;
+  char id;            // its letter once the server says OK; 0 before
+  bool done;          // whether the server has said QUIT
+  bool turnedAway;    // whether it said QUIT before OK
+  int purse;
+
+  // the map, rows lines of cols characters and '\n'; NULL until GRID
+  int rows;
+  int cols;
+  char* map;
+  unsigned int deltaNumber; // number of the last DELTA applied
+  bool resyncing;     // whether it asked to start DELTAs over
+
+  long keyIndex;      // the next key of the script
+  int heading;        // the move it wanders on with, when greedy
+  double joinAt;      // when to send PLAY, in seconds
+  bool joining;       // whether PLAY has been sent
+  double nextKey;     // when to press the next key, in seconds
+  unsigned long nextSeq;            // for the next KEY
+  unsigned long sentSeq[MAXTRACES]; // the KEY sent at each time below
+  double sentAt[MAXTRACES];         // when; 0 once its echo has come
+  double frameDue[MAXTRACES];       // when, too; 0 once a frame echoing
+                                    // it has come
+} bot_t;
+
+
+/************ struct samples **************/
+/* a growing list of times, in milliseconds */
+typedef struct samples {
+  double* values;
+  long count;
+  long size;
+} samples_t;
+
+
+/************ struct stats **************/
+/* counts for the summary */
+typedef struct stats {
+  long keys;          // KEY messages sent
+  long messages;      // messages received
+  long bytes;         // bytes received
+  long displays;      // DISPLAY messages received
+  long deltas;        // DELTA messages received
+  long resyncs;       // times a bot asked to start DELTAs over
+  long framesLost;    // DELTA numbers skipped
+  long keysUnanswered; // keys no frame echoing them came for
+
+  samples_t keyToFrame;  // from each key to the frame echoing its number
+  samples_t roundTrip;   // from each key to the echo of its number
+  samples_t inServer;    // of which in the server
+  samples_t onNetwork;   // and the rest
+} stats_t;
+
+
+// function prototypes
+static int parseArgs(const int argc, char* argv[], options_t* options);
+static char* readScript(const char* filename);
+static void raiseFileLimit(const int numBots);
+static void sendTo(bot_t* bot, const char* message);
+static void handleMessage(bot_t* bot, const char* message, stats_t* stats,
+                          const bool wantDeltas, const double time);
+static void noteTrace(bot_t* bot, const char* message, stats_t* stats,
+                      const double time);
+static void addSample(samples_t* samples, const double millis);
+static double percentile(const samples_t* sorted, const double fraction);
+static void printSamples(const char* name, samples_t* samples);
+static void writeSamples(FILE* fp, const char* name, const samples_t* sorted,
+                         const bool last);
+static int compareDoubles(const void* a, const void* b);
+static void writeReport(FILE* fp, const options_t* options,
+                        const stats_t* stats, const int numJoined,
+                        const int numTurnedAway, const double elapsed);
+static void handleGRID(bot_t* bot, const char* message);
+static void handleDELTA(bot_t* bot, const char* message, stats_t* stats);
+static char chooseKey(bot_t* bot, const policy_t policy, const char* script);
+static char greedyKey(bot_t* bot);
+static bool isOpen(const bot_t* bot, const int x, const int y);
+static double now(void);
+
+// room for the search behind greedyKey, shared by every bot
+static int* searchQueue = NULL;
+static char* searchFirst = NULL;   // the first move toward each cell
+static int searchSize = 0;
+
+
+/***************** main() *****************/
+/*
+ * Caller provides:
+ *  the command line described at the top of the file
+ * We do:
+ *  join the bots to the servers, play until the time is up or every
+ *  game is over, then quit them all and print a summary
+ * We return:
+ *  0 on success, nonzero for bad arguments or a failure to set up
+ */
+int
+main(const int argc, char* argv[])
+{
+  options_t options = {
+    .numServers = 0, .numBots = defaultBots,
+    .policy = policy_random, .policyName = "random", .script = NULL,
+    .rate = defaultRate, .seconds = defaultSeconds, .ramp = 0, .report = NULL,
+  };
+
+  int errorParseArgs = parseArgs(argc, argv, &options);
+  if (errorParseArgs != 0) {
+    return errorParseArgs;
+  }
+  int numBots = options.numBots;
+  float rate = options.rate;
+
+  // bots ask for DELTAs as the client does, unless NUGGETS_DELTA=0
+  const char* deltaString = getenv("NUGGETS_DELTA");
+  bool wantDeltas = deltaString == NULL || strcmp(deltaString, "0") != 0;
+
+  raiseFileLimit(numBots);
+  bot_t* bots = calloc(numBots, sizeof(bot_t));
+  struct pollfd* polls = calloc(numBots, sizeof(struct pollfd));
+  if (bots == NULL || polls == NULL) {
+    fprintf(stderr, "Error: out of memory\n");
+    return 1;
+  }
+
+  // each from its own socket, joining in turn over the ramp
+  double start = now();
+  for (int i = 0; i < numBots; i++) {
+    bot_t* bot = &bots[i];
+    bot->socket = socket(AF_INET, SOCK_DGRAM, 0);
+    if (bot->socket < 0) {
+      fprintf(stderr, "Error: could only open sockets for %d bots\n", i);
+      return 1;
+    }
+    bot->server = options.servers[i % options.numServers];
+    bot->heading = rand() % numMoves;
+    bot->joinAt = start + options.ramp * i / numBots;
+    bot->nextKey = bot->joinAt + (rand() / (RAND_MAX + 1.0)) / rate; // spread out
+    polls[i].fd = bot->socket;
+    polls[i].events = POLLIN;
+  }
+
+  // play until the time is up or every bot is done
+  stats_t stats = { 0 };
+  char buf[message_MaxBytes];
+  double end = start + options.seconds;
+  double time = start;
+  for (time = now(); time < end; time = now()) {
+
+    // join and press the keys that are due, and see when the next one is
+    double next = end;
+    int numPlaying = 0;
+    for (int i = 0; i < numBots; i++) {
+      bot_t* bot = &bots[i];
+      if (bot->done) {
+        continue;
+      }
+      numPlaying++;
+      if (!bot->joining) {
+        if (bot->joinAt <= time) {
+          char message[32];
+          snprintf(message, sizeof(message), "PLAY bot%d", i);
+          sendTo(bot, message);
+          bot->joining = true;
+        } else if (bot->joinAt < next) {
+          next = bot->joinAt;
+        }
+        continue;
+      }
+      if (bot->id == 0) {
+        continue; // not in the game yet
+      }
+      if (bot->nextKey <= time) {
+        char key = chooseKey(bot, options.policy, options.script);
+        unsigned long seq = ++bot->nextSeq;
+        char message[32];
+        snprintf(message, sizeof(message), "KEY %c %lu", key, seq);
+        sendTo(bot, message);
+        if (bot->frameDue[seq % MAXTRACES] != 0) {
+          stats.keysUnanswered++; // forgotten before its frame came
+        }
+        bot->sentSeq[seq % MAXTRACES] = seq;
+        bot->sentAt[seq % MAXTRACES] = time;
+        bot->frameDue[seq % MAXTRACES] = time;
+        stats.keys++;
+
+        // keep to the rate, but do not catch up in a burst if we fell behind
+        bot->nextKey += 1 / rate;
+        if (bot->nextKey < time) {
+          bot->nextKey = time + 1 / rate;
+        }
+      }
+      if (bot->nextKey < next) {
+        next = bot->nextKey;
+      }
+    }
+    if (numPlaying == 0) {
+      break;
+    }
+
+    // and handle what came in meanwhile
+    int wait = (next - time) * 1000;
+    wait = wait < 0 ? 0 : (wait > maxWaitMillis ? maxWaitMillis : wait);
+    if (poll(polls, numBots, wait) <= 0) {
+      continue;
+    }
+    for (int i = 0; i < numBots; i++) {
+      if ((polls[i].revents & POLLIN) == 0) {
+        continue;
+      }
+      int nbytes = recv(polls[i].fd, buf, message_MaxBytes - 1, 0);
+      if (nbytes < 0) {
+        continue;
+      }
+      buf[nbytes] = '\0';
+      stats.messages++;
+      stats.bytes += nbytes;
+      handleMessage(&bots[i], buf, &stats, wantDeltas, now());
+    }
+  }
+  double elapsed = time - start;
+
+  // say goodbye, and count up
+  int numJoined = 0;
+  int numTurnedAway = 0;
+  int numWaiting = 0;
+  long gold = 0;
+  for (int i = 0; i < numBots; i++) {
+    bot_t* bot = &bots[i];
+    if (bot->id != 0) {
+      numJoined++;
+      gold += bot->purse;
+      if (!bot->done) {
+        sendTo(bot, "KEY Q");
+      }
+    } else if (bot->turnedAway) {
+      numTurnedAway++;
+    } else if (bot->joining) {
+      numWaiting++;
+    }
+    for (int s = 0; s < MAXTRACES; s++) {
+      if (bot->frameDue[s] != 0) {
+        stats.keysUnanswered++;
+      }
+    }
+    close(bot->socket);
+    free(bot->map);
+  }
+
+  printf("bots: %d joined, %d turned away, %d never answered\n",
+         numJoined, numTurnedAway, numWaiting);
+  printf("time: %.2f s\n", elapsed);
+  printf("keys sent: %ld (%.0f/s)\n", stats.keys, stats.keys / elapsed);
+  printf("messages received: %ld (%.0f/s), %ld bytes (%.0f/s)\n",
+         stats.messages, stats.messages / elapsed,
+         stats.bytes, stats.bytes / elapsed);
+  printf("frames: %ld DISPLAY, %ld DELTA, %ld resyncs\n",
+         stats.displays, stats.deltas, stats.resyncs);
+  printf("gold collected: %ld\n", gold);
+
+  printSamples("key to frame", &stats.keyToFrame);
+  printf("  %ld keys with no frame\n", stats.keysUnanswered);
+  printSamples("key to its echo", &stats.roundTrip);
+  printSamples("  in the server", &stats.inServer);
+  printSamples("  on the network", &stats.onNetwork);
+  printf("frames: %.0f/s, %.1f/s for each bot; %ld lost\n",
+         (stats.displays + stats.deltas) / elapsed,
+         numJoined > 0 ? (stats.displays + stats.deltas) / elapsed / numJoined : 0,
+         stats.framesLost);
+
+  int status = 0;
+  if (options.report != NULL) {
+    FILE* fp = fopen(options.report, "w");
+    if (fp == NULL) {
+      fprintf(stderr, "Error: cannot write %s\n", options.report);
+      status = 1;
+    } else {
+      writeReport(fp, &options, &stats, numJoined, numTurnedAway, elapsed);
+      fclose(fp);
+    }
+  }
+
+  free(bots);
+  free(polls);
+  free(options.script);
+  free(stats.keyToFrame.values);
+  free(stats.roundTrip.values);
+  free(stats.inServer.values);
+  free(stats.onNetwork.values);
+  free(searchQueue);
+  free(searchFirst);
+  return status;
+}
+
+/***************** parseArgs() *****************/
+/*
+ * Caller provides:
+ *  command line arguments and the options to fill in
+ * We do:
+ *  parse the arguments, reading the script if one is named
+ * We return:
+ *  0 on valid parameters, anything else means invalid parameters
+ */
+static int parseArgs(const int argc, char* argv[], options_t* options) {
+
+  // the flags come first
+  char extra;
+  int first = 1;
+  while (first + 1 < argc && argv[first][0] == '-') {
+    if (strcmp(argv[first], "-ramp") == 0) {
+      if (sscanf(argv[first + 1], "%f%c", &options->ramp, &extra) != 1
+          || options->ramp < 0) {
+        fprintf(stderr, "Error: ramp must be a number of seconds\n");
+        return 9;
+      }
+    } else if (strcmp(argv[first], "-json") == 0) {
+      options->report = argv[first + 1];
+    } else {
+      break;
+    }
+    first += 2;
+  }
+
+  int numArgs = argc - first;
+  if (numArgs < 2 || numArgs > 7) {
+    fprintf(stderr, "usage: %s [-ramp seconds] [-json report.json] hostname port[,port...] "
+            "[bots [random|greedy|keyfile [keys/s [seconds [seed]]]]]\n", argv[0]);
+    return 2;
+  }
+  char** args = argv + first - 1; // so args[1] is the hostname
+
+  // one address for each port
+  char ports[strlen(args[2]) + 1];
+  strcpy(ports, args[2]);
+  for (char* port = strtok(ports, ","); port != NULL; port = strtok(NULL, ",")) {
+    if (options->numServers == MAXSERVERS) {
+      fprintf(stderr, "Error: at most %d ports\n", MAXSERVERS);
+      return 3;
+    }
+    if (!message_setAddr(args[1], port, &options->servers[options->numServers])) {
+      fprintf(stderr, "Error: bad hostname or port '%s %s'\n", args[1], port);
+      return 3;
+    }
+    options->numServers++;
+  }
+  if (options->numServers == 0) {
+    fprintf(stderr, "Error: no port given\n");
+    return 3;
+  }
+
+  if (numArgs > 2 && (sscanf(args[3], "%d%c", &options->numBots, &extra) != 1
+                      || options->numBots < 1)) {
+    fprintf(stderr, "Error: bots must be a positive number\n");
+    return 4;
+  }
+
+  if (numArgs > 3) {
+    options->policyName = args[4];
+    if (strcmp(args[4], "random") == 0) {
+      options->policy = policy_random;
+    } else if (strcmp(args[4], "greedy") == 0) {
+      options->policy = policy_greedy;
+    } else if ((options->script = readScript(args[4])) != NULL) {
+      options->policy = policy_script;
+    } else {
+      fprintf(stderr, "Error: policy must be random, greedy or a file of keys\n");
+      return 5;
+    }
+  }
+
+  if (numArgs > 4 && (sscanf(args[5], "%f%c", &options->rate, &extra) != 1
+                      || options->rate <= 0)) {
+    fprintf(stderr, "Error: keys/s must be a positive number\n");
+    return 6;
+  }
+
+  if (numArgs > 5 && (sscanf(args[6], "%f%c", &options->seconds, &extra) != 1
+                      || options->seconds <= 0)) {
+    fprintf(stderr, "Error: seconds must be a positive number\n");
+    return 7;
+  }
+
+  int seed;
+  if (numArgs > 6) {
+    if (sscanf(args[7], "%d%c", &seed, &extra) != 1 || seed < 0) {
+      fprintf(stderr, "Error: seed must be a non-negative number\n");
+      return 8;
+    }
+    srand(seed);
+  } else {
+    srand(getpid());
+  }
+
+  return 0;
+}
+
+/***************** readScript() *****************/
+/*
+ * Caller provides:
+ *  the name of a file of keys
+ * We do:
+ *  read the keys, leaving out whitespace
+ * We return:
+ *  a string of them, for the caller to free; NULL if the file cannot
+ *  be read or has no keys
+ */
+static char* readScript(const char* filename) {
+
+  FILE* fp = fopen(filename, "r");
+  if (fp == NULL) {
+    return NULL;
+  }
+
+  size_t size = 64;
+  size_t length = 0;
+  char* keys = malloc(size);
+  int c;
+  while (keys != NULL && (c = fgetc(fp)) != EOF) {
+    if (isspace(c)) {
+      continue;
+    }
+    if (length + 1 == size) {
+      size *= 2;
+      char* bigger = realloc(keys, size);
+      if (bigger == NULL) {
+        free(keys);
+      }
+      keys = bigger;
+      if (keys == NULL) {
+        break;
+      }
+    }
+    keys[length++] = c;
+  }
+  fclose(fp);
+
+  if (keys != NULL && length == 0) {
+    free(keys);
+    keys = NULL;
+  }
+  if (keys != NULL) {
+    keys[length] = '\0';
+  }
+  return keys;
+}
+
+/***************** raiseFileLimit() *****************/
+/*
+ * Caller provides:
+ *  the number of bots
+ * We do:
+ *  let the process open a socket for each of them, as far as the
+ *  system allows
+ * We return:
+ *  void
+ */
+static void raiseFileLimit(const int numBots) {
+
+  struct rlimit limit;
+  rlim_t wanted = numBots + 16; // and stdin, stdout, stderr, ...
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < wanted) {
+    limit.rlim_cur = wanted < limit.rlim_max ? wanted : limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+}
+
+/***************** sendTo() *****************/
+/*
+ * Caller provides:
+ *  a bot and a message
+ * We do:
+ *  send the message to the bot's server from the bot's socket
+ * We return:
+ *  void
+ */
+static void sendTo(bot_t* bot, const char* message) {
+  sendto(bot->socket, message, strlen(message), 0,
+         (struct sockaddr*) &bot->server, sizeof(bot->server));
+}
+
+/***************** handleMessage() *****************/
+/*
+ * Caller provides:
+ *  the bot it came to, the message, the counts to add to, whether
+ *  to ask for DELTAs, and when the message came
+ * We do:
+ *  update what the bot knows of its game, timing the bot's key whose
+ *  number this echoes, if any
+ * We return:
+ *  void
+ */
+static void handleMessage(bot_t* bot, const char* message, stats_t* stats,
+                          const bool wantDeltas, const double time) {
+
+  if (strncmp(message, "OK ", strlen("OK ")) == 0) {
+    bot->id = message[strlen("OK ")];
+  }
+  else if (strncmp(message, "GRID ", strlen("GRID ")) == 0) {
+    handleGRID(bot, message);
+    if (wantDeltas && bot->map != NULL) {
+      sendTo(bot, "MODE DELTA");
+    }
+  }
+  else if (strncmp(message, "GOLD ", strlen("GOLD ")) == 0) {
+    int collected;
+    sscanf(message, "GOLD %d %d", &collected, &bot->purse);
+  }
+  else if (strncmp(message, "DISPLAY", strlen("DISPLAY")) == 0) {
+    stats->displays++;
+    const char* map = strchr(message, '\n');
+    if (bot->map != NULL && bot->deltaNumber == 0 && map != NULL) {
+      size_t length = bot->rows * (bot->cols + 1);
+      if (strlen(map + 1) == length) {
+        memcpy(bot->map, map + 1, length);
+      }
+    }
+  }
+  else if (strncmp(message, "DELTA ", strlen("DELTA ")) == 0) {
+    stats->deltas++;
+    handleDELTA(bot, message, stats);
+  }
+  else if (strncmp(message, "QUIT ", strlen("QUIT ")) == 0) {
+    bot->turnedAway = bot->id == 0;
+    bot->done = true;
+  }
+  noteTrace(bot, message, stats, time);
+}
+
+/***************** noteTrace() *****************/
+/*
+ * Caller provides:
+ *  the bot, a message it was sent, the counts, and when it came
+ * We do:
+ *  if its first line ends with the echo of one of the bot's KEYs,
+ *  " seq received sent": if it is a frame, and the first for that KEY,
+ *  add how long the KEY took to its frame; if it is the first echo of
+ *  any kind, add how long the KEY took there and back, in the server
+ *  (sent - received, by the server's clock) and on the network
+ * We return:
+ *  void
+ */
+static void noteTrace(bot_t* bot, const char* message, stats_t* stats,
+                      const double time) {
+
+  unsigned long seq;
+  long long received, sent;
+  if (!delta_parseTrace(message, &seq, &received, &sent)
+      || bot->sentSeq[seq % MAXTRACES] != seq) {
+    return;
+  }
+
+  // a GOLD can come first, but only a frame answers the KEY
+  bool isFrame = strncmp(message, "GOLD ", strlen("GOLD ")) != 0;
+  if (isFrame && bot->frameDue[seq % MAXTRACES] != 0) {
+    addSample(&stats->keyToFrame, (time - bot->frameDue[seq % MAXTRACES]) * 1000);
+    bot->frameDue[seq % MAXTRACES] = 0;
+  }
+  if (bot->sentAt[seq % MAXTRACES] == 0) {
+    return;
+  }
+
+  double roundTrip = (time - bot->sentAt[seq % MAXTRACES]) * 1000;
+  double inServer = (sent - received) / 1000.0;
+  bot->sentAt[seq % MAXTRACES] = 0;
+  addSample(&stats->roundTrip, roundTrip);
+  addSample(&stats->inServer, inServer);
+  addSample(&stats->onNetwork, roundTrip - inServer);
+}
+
+/***************** addSample() *****************/
+/*
+ * Caller provides:
+ *  the samples and a time in milliseconds
+ * We do:
+ *  add it to them, making room as needed
+ * We return:
+ *  void
+ */
+static void addSample(samples_t* samples, const double millis) {
+
+  if (samples->count == samples->size) {
+    long size = samples->size == 0 ? 1024 : 2 * samples->size;
+    double* bigger = realloc(samples->values, size * sizeof(double));
+    if (bigger == NULL) {
+      return; // keep the ones we have
+    }
+    samples->values = bigger;
+    samples->size = size;
+  }
+  samples->values[samples->count++] = millis;
+}
+
+/***************** percentile() *****************/
+/*
+ * returns the given fraction's percentile (nearest rank) of sorted
+ * samples; 0 if there are none
+ */
+static double percentile(const samples_t* sorted, const double fraction) {
+  if (sorted->count == 0) {
+    return 0;
+  }
+  long rank = (long) (fraction * sorted->count + 0.999999);
+  return sorted->values[rank < 1 ? 0 : rank - 1];
+}
+
+/***************** printSamples() *****************/
+/*
+ * sorts the samples and prints their percentiles, as name
+ */
+static void printSamples(const char* name, samples_t* samples) {
+  qsort(samples->values, samples->count, sizeof(double), compareDoubles);
+  printf("%s: p50 %.2f ms, p95 %.2f ms, p99 %.2f ms (%ld keys)\n", name,
+         percentile(samples, 0.50), percentile(samples, 0.95),
+         percentile(samples, 0.99), samples->count);
+}
+
+/***************** compareDoubles() *****************/
+/*
+ * orders doubles for qsort
+ */
+static int compareDoubles(const void* a, const void* b) {
+  double x = *(const double*) a;
+  double y = *(const double*) b;
+  return (x > y) - (x < y);
+}
+
+/***************** writeReport() *****************/
+/*
+ * Caller provides:
+ *  an open file, the options, the counts (samples sorted), and what
+ *  the summary says
+ * We do:
+ *  write the summary to the file as a JSON object
+ * We return:
+ *  void
+ */
+static void writeReport(FILE* fp, const options_t* options,
+                        const stats_t* stats, const int numJoined,
+                        const int numTurnedAway, const double elapsed) {
+
+  long frames = stats->displays + stats->deltas;
+  fprintf(fp, "{\n");
+  fprintf(fp, "  \"bots\": %d,\n", options->numBots);
+  fprintf(fp, "  \"servers\": %d,\n", options->numServers);
+  fprintf(fp, "  \"joined\": %d,\n", numJoined);
+  fprintf(fp, "  \"turnedAway\": %d,\n", numTurnedAway);
+  fprintf(fp, "  \"policy\": \"");
+  for (const char* c = options->policyName; *c != '\0'; c++) {
+    if (*c == '"' || *c == '\\') {
+      fputc('\\', fp);
+    }
+    fputc(*c, fp);
+  }
+  fprintf(fp, "\",\n");
+  fprintf(fp, "  \"keysPerSecondPerBot\": %g,\n", options->rate);
+  fprintf(fp, "  \"rampSeconds\": %g,\n", options->ramp);
+  fprintf(fp, "  \"seconds\": %.3f,\n", elapsed);
+  fprintf(fp, "  \"keys\": %ld,\n", stats->keys);
+  fprintf(fp, "  \"keysPerSecond\": %.1f,\n", stats->keys / elapsed);
+  fprintf(fp, "  \"messages\": %ld,\n", stats->messages);
+  fprintf(fp, "  \"bytes\": %ld,\n", stats->bytes);
+  fprintf(fp, "  \"bytesPerSecond\": %.0f,\n", stats->bytes / elapsed);
+  fprintf(fp, "  \"frames\": %ld,\n", frames);
+  fprintf(fp, "  \"framesPerSecond\": %.1f,\n", frames / elapsed);
+  fprintf(fp, "  \"framesPerSecondPerBot\": %.2f,\n",
+          numJoined > 0 ? frames / elapsed / numJoined : 0);
+  fprintf(fp, "  \"framesLost\": %ld,\n", stats->framesLost);
+  fprintf(fp, "  \"frameLossRate\": %.6f,\n",
+          stats->deltas + stats->framesLost > 0
+          ? (double) stats->framesLost / (stats->deltas + stats->framesLost) : 0);
+  fprintf(fp, "  \"resyncs\": %ld,\n", stats->resyncs);
+  fprintf(fp, "  \"keysWithNoFrame\": %ld,\n", stats->keysUnanswered);
+  writeSamples(fp, "latencyMs", &stats->keyToFrame, false);
+  writeSamples(fp, "roundTripMs", &stats->roundTrip, false);
+  writeSamples(fp, "serverMs", &stats->inServer, false);
+  writeSamples(fp, "networkMs", &stats->onNetwork, true);
+  fprintf(fp, "}\n");
+}
+
+/***************** writeSamples() *****************/
+/*
+ * writes sorted samples to the report as the JSON member name, with
+ * a comma after unless it is the last
+ */
+static void writeSamples(FILE* fp, const char* name, const samples_t* sorted,
+                         const bool last) {
+  fprintf(fp, "  \"%s\": {\n", name);
+  fprintf(fp, "    \"samples\": %ld,\n", sorted->count);
+  fprintf(fp, "    \"p50\": %.3f,\n", percentile(sorted, 0.50));
+  fprintf(fp, "    \"p95\": %.3f,\n", percentile(sorted, 0.95));
+  fprintf(fp, "    \"p99\": %.3f,\n", percentile(sorted, 0.99));
+  fprintf(fp, "    \"max\": %.3f\n", percentile(sorted, 1.0));
+  fprintf(fp, "  }%s\n", last ? "" : ",");
+}
+
+/***************** handleGRID() *****************/
+/*
+ * Caller provides:
+ *  the bot and the GRID message
+ * We do:
+ *  make room for a map of that size, blank for now
+ * We return:
+ *  void
+ */
+static void handleGRID(bot_t* bot, const char* message) {
+
+  int rows, cols;
+  if (sscanf(message, "GRID %d %d", &rows, &cols) != 2 || rows < 1 || cols < 1) {
+    return;
+  }
+  bot->rows = rows;
+  bot->cols = cols;
+  free(bot->map);
+  bot->map = malloc(rows * (cols + 1) + 1);
+  if (bot->map == NULL) {
+    return;
+  }
+  delta_blank(bot->map, rows, cols);
+  bot->deltaNumber = 0;
+  bot->resyncing = false;
+}
+
+/***************** handleDELTA() *****************/
+/*
+ * Caller provides:
+ *  the bot, the DELTA message, and the counts to add to
+ * We do:
+ *  apply it to the bot's map as the client does: DELTA 1 starts from
+ *  a blank map, and if one goes missing we ask to start over
+ * We return:
+ *  void
+ */
+static void handleDELTA(bot_t* bot, const char* message, stats_t* stats) {
+
+  unsigned int number;
+  const char* lines = strchr(message, '\n');
+  if (bot->map == NULL || lines == NULL
+      || sscanf(message, "DELTA %u", &number) != 1) {
+    return;
+  }
+
+  if (number == 1) {
+    delta_blank(bot->map, bot->rows, bot->cols);
+    bot->resyncing = false;
+  } else if (bot->resyncing) {
+    return; // waiting for DELTA 1
+  } else if (number != bot->deltaNumber + 1) {
+    if (number > bot->deltaNumber) {
+      stats->framesLost += number - bot->deltaNumber - 1;
+    }
+    sendTo(bot, "MODE DELTA");
+    bot->resyncing = true;
+    stats->resyncs++;
+    return;
+  }
+  bot->deltaNumber = number;
+
+  if (!delta_apply(bot->map, bot->rows, bot->cols, lines + 1)) {
+    sendTo(bot, "MODE DELTA");
+    bot->resyncing = true;
+    stats->resyncs++;
+  }
+}
+
+/***************** chooseKey() *****************/
+/*
+ * Caller provides:
+ *  the bot, the policy, and the script if the policy is one
+ * We do:
+ *  pick the bot's next key
+ * We return:
+ *  the key
+ */
+static char chooseKey(bot_t* bot, const policy_t policy, const char* script) {
+
+  switch (policy) {
+    case policy_greedy:
+      return greedyKey(bot);
+    case policy_script: {
+      char key = script[bot->keyIndex++];
+      if (script[bot->keyIndex] == '\0') {
+        bot->keyIndex = 0;
+      }
+      return key;
+    }
+    default:
+      return moveKeys[rand() % numMoves];
+  }
+}
+
+/***************** greedyKey() *****************/
+/*
+ * Caller provides:
+ *  the bot
+ * We do:
+ *  search outward from the bot for the nearest gold it can see; with
+ *  none, keep going the way it was going, turning at random when it
+ *  cannot
+ * We return:
+ *  the key for the first move
+ */
+static char greedyKey(bot_t* bot) {
+
+  if (bot->map == NULL) {
+    return moveKeys[rand() % numMoves];
+  }
+  const char* at = strchr(bot->map, '@');
+  if (at == NULL) {
+    return moveKeys[rand() % numMoves];
+  }
+  int width = bot->cols + 1;
+  int start = at - bot->map;
+
+  int size = bot->rows * width;
+  if (size > searchSize) {
+    free(searchQueue);
+    free(searchFirst);
+    searchQueue = malloc(size * sizeof(int));
+    searchFirst = malloc(size);
+    searchSize = searchQueue != NULL && searchFirst != NULL ? size : 0;
+    if (searchSize == 0) {
+      return moveKeys[rand() % numMoves];
+    }
+  }
+
+  // breadth first, remembering the first move that reached each cell
+  memset(searchFirst, -1, size);
+  int head = 0;
+  int tail = 0;
+  searchQueue[tail++] = start;
+  searchFirst[start] = numMoves;
+  while (head < tail) {
+    int cell = searchQueue[head++];
+    int x = cell % width;
+    int y = cell / width;
+    for (int m = 0; m < numMoves; m++) {
+      int nx = x + moveDx[m];
+      int ny = y + moveDy[m];
+      if (!isOpen(bot, nx, ny) || searchFirst[ny * width + nx] != -1) {
+        continue;
+      }
+      int next = ny * width + nx;
+      searchFirst[next] = cell == start ? m : searchFirst[cell];
+      if (bot->map[next] == '*') {
+        return moveKeys[(int) searchFirst[next]];
+      }
+      searchQueue[tail++] = next;
+    }
+  }
+
+  // no gold in sight: wander
+  int x = start % width;
+  int y = start / width;
+  for (int tries = 0; tries < numMoves
+       && !isOpen(bot, x + moveDx[bot->heading], y + moveDy[bot->heading]); tries++) {
+    bot->heading = rand() % numMoves;
+  }
+  return moveKeys[bot->heading];
+}
+
+/***************** isOpen() *****************/
+/*
+ * returns whether the bot's map shows a cell it could step onto
+ */
+static bool isOpen(const bot_t* bot, const int x, const int y) {
+  if (x < 0 || x >= bot->cols || y < 0 || y >= bot->rows) {
+    return false;
+  }
+  char c = bot->map[y * (bot->cols + 1) + x];
+  return c == '.' || c == '#' || c == '*' || isalpha((unsigned char) c);
+}
+
+/***************** now() *****************/
+/*
+ * returns the current time in seconds
+ */
+static double now(void) {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
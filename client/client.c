@@ -5,20 +5,44 @@
  * 
  */ 
 
+#define _DEFAULT_SOURCE    // for SIGWINCH
+
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
 #include "../support/log.h"
 #include "../support/message.h"
+#include "../support/delta.h"
 #include <ncurses.h>
 #include <unistd.h>
+#include <time.h>
+#include <ctype.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+
+// the most own moves shown ahead of the server at once
+#define MAXPREDICTIONS 32
+
+// the most keys whose send times are remembered, for timing their echoes
+#define MAXTRACES 64
 
 
 /************ struct clientData **************/
 /* wraps all the neccesary data that a client should 
  * be able to access in one struct */
 typedef struct clientData {
+  // three threads share this: the main one reads keys and sends them,
+  // one receives messages and one draws; lock guards all of it except
+  // the DELTA state, which only the receiver uses
+  pthread_mutex_t lock;
+  pthread_cond_t changed; // signalled when there is something new to draw
+  bool quitting;          // whether the game is over, for every thread
+  char* quitMessage;      // what the server's QUIT said, to show at the end
+  bool statusChanged;     // whether the status line has not been drawn yet
+
   // player's characteristics
   char id;
   int purse;
@@ -29,6 +53,58 @@ typedef struct clientData {
   int rows;
   int cols;
   bool spectator;
+  bool tooSmall;      // whether the terminal cannot show the map just now
+  char status[128];   // the status line, to show again after a resize
+
+  // the part of the map on screen, viewRows by viewCols cells from row
+  // viewTop and column viewLeft; it scrolls to follow the player, or as
+  // the spectator pans it
+  int viewRows;
+  int viewCols;
+  int viewTop;
+  int viewLeft;
+
+  // the view as last drawn on screen, row after row of viewCols chars;
+  // NULL until the GRID message says how big the map is
+  char* frame;
+  bool frameValid; // false if the screen may not match frame
+
+  // what has come in but is not on screen yet; only the newest
+  // DISPLAY matters, so each replaces the last, and the render thread
+  // draws whichever is newest when it gets round to it
+  char* latest;       // the newest DISPLAY message, once one has come
+  bool latestPending; // whether latest has not been drawn yet
+  bool dirty;         // whether anything has been drawn but not refreshed
+  double lastRedraw;  // when the screen was last refreshed, in seconds
+  double minInterval; // the least time between redraws, in seconds
+
+  // our own moves are shown before the server confirms them, on a copy
+  // of the newest DISPLAY; positions are indices into its map
+  char* view;         // the newest DISPLAY with our predicted moves made
+  char* terrain;      // what each cell of the map was last seen to hold,
+                      // not counting players; NULL until GRID
+  int confirmedAt;    // where the server last showed us; -1 if unknown
+  int predicted[MAXPREDICTIONS]; // where each unconfirmed move took us
+  int numPredicted;
+  int numPredictions; // moves predicted so far
+  int numMismatches;  // times the server put us somewhere unpredicted
+
+  // with MODE DELTA the server sends only the cells that changed, which
+  // are written into a DISPLAY message kept here; the receiver decodes
+  // into it unlocked, and copies it to latest under the lock when done
+  char* cache;        // "DISPLAY\n" then the map; NULL until GRID
+  bool deltas;        // whether a DELTA has come, so DISPLAYs are stale
+  unsigned int deltaNumber; // number of the last DELTA applied
+  bool resyncing;     // whether we asked to start over and are waiting
+
+  // each KEY carries a sequence number, which the server echoes with its
+  // own times in the first DISPLAY, DELTA or GOLD it causes
+  unsigned long nextSeq;               // for the next KEY
+  unsigned long sentSeq[MAXTRACES];    // the KEY sent at each time below
+  double sentAt[MAXTRACES];            // when; 0 once its echo has come
+  int numTraced;      // keys whose echo has come
+  double totalRoundTrip; // their times there and back, in seconds
+  double totalServer;    // of which in the server
   
 } clientData_t;
 
@@ -36,6 +112,7 @@ typedef struct clientData {
 // function prototypes 
 static bool handleInput(void* arg);
 static bool handleMessage(void* arg, const addr_t from, const char* message);
+static bool handleOther(const char* message, const addr_t from);
 static int parseArgs(const int argc, char* argv[], clientData_t* cData);
 static void initializeTerminal(void);
 static void handleGRID(const char* message, void* arg);
@@ -43,7 +120,48 @@ static void handleGOLD(const char* message, void* arg);
 static void handleQUIT(const char* message, void *arg);
 static void handleERROR(const char* message);
 static void handleDISPLAY(const char* message, void* arg);
+static void handleDELTA(const char* message, const addr_t from, void* arg);
 static void handleOK(const char* message, void* arg);
+static void drawRow(const char* line, char* drawn, const int length,
+                    const int cols, const int y);
+static void drawDisplay(clientData_t* cData);
+static void* receiveMain(void* arg);
+static void* renderMain(void* arg);
+static void waitFor(clientData_t* cData, const double seconds);
+static bool handleTimeout(void* arg);
+static double now(void);
+static void predictMove(clientData_t* cData, const char key);
+static void reconcile(clientData_t* cData);
+static void makeView(clientData_t* cData);
+static void reportPredictions(clientData_t* cData);
+static void noteTrace(clientData_t* cData, const char* message);
+static void reportLatency(clientData_t* cData);
+static void onResize(int sig);
+static void checkResize(clientData_t* cData);
+static void checkSize(clientData_t* cData);
+static void scrollView(clientData_t* cData, const char* map);
+static bool panView(clientData_t* cData, const char key);
+
+// the most times a second the screen is redrawn, unless the
+// NUGGETS_MAXFPS environment variable says otherwise
+static const float defaultMaxFPS = 60;
+
+// what a DELTA is written into before it is handled as a DISPLAY
+static const char* displayHeader = "DISPLAY\n";
+
+// set when the terminal is resized, or a GRID comes; the render thread
+// fits the view to the screen at its next redraw; atomic, being set by
+// other threads as well as the signal handler
+static atomic_int resized = 0;
+
+// how often, in seconds, the threads waiting on stdin and on the socket
+// look to see if the game has ended
+static const float pollInterval = 0.1;
+
+// the smallest terminal we can play in: the status line, and a few rows
+// and columns of the map
+static const int minRows = 4;
+static const int minCols = 20;
 
 
 // global client data since can't pass specify arg to pass in messages
@@ -97,11 +215,70 @@ main(const int argc, char* argv[])
     return 4; // bad hostname/port
   }
 
-  // listen for and send messages
-  bool ok = message_loop(&server, 0, NULL, handleInput, handleMessage);
+  // redraw at most so many times a second; a frame held back is drawn
+  // when the socket goes quiet for that long
+  float maxFPS = defaultMaxFPS;
+  const char* fpsString = getenv("NUGGETS_MAXFPS");
+  if (fpsString != NULL && (sscanf(fpsString, "%f", &maxFPS) != 1 || maxFPS <= 0)) {
+    maxFPS = defaultMaxFPS;
+  }
+  cData.minInterval = 1.0 / maxFPS;
+  cData.latest = malloc(message_MaxBytes);
+  cData.view = malloc(message_MaxBytes);
+  cData.confirmedAt = -1;
+  if (cData.latest == NULL || cData.view == NULL) {
+    endwin();
+    fprintf(stderr, "Error: out of memory\n");
+    return 1;
+  }
+
+  // receive and draw on threads of their own, so that neither a slow
+  // terminal nor a burst of messages holds up the keys we send
+  pthread_mutex_init(&cData.lock, NULL);
+  pthread_cond_init(&cData.changed, NULL);
+  pthread_t receiver;
+  pthread_t renderer;
+  if (pthread_create(&receiver, NULL, receiveMain, &cData) != 0) {
+    endwin();
+    fprintf(stderr, "Error: could not start the receive thread\n");
+    return 1;
+  }
+  if (pthread_create(&renderer, NULL, renderMain, &cData) != 0) {
+    endwin();
+    fprintf(stderr, "Error: could not start the render thread\n");
+    return 1;
+  }
+
+  // read keys and send them
+  bool ok = message_loop(&server, pollInterval, handleTimeout,
+                         handleInput, NULL);
+
+  // however the game ended, stop the other threads
+  pthread_mutex_lock(&cData.lock);
+  cData.quitting = true;
+  pthread_cond_broadcast(&cData.changed);
+  pthread_mutex_unlock(&cData.lock);
+  pthread_join(receiver, NULL);
+  pthread_join(renderer, NULL);
+
+  // end the window, then print the QUIT message if there was one
+  endwin();
+  if (cData.quitMessage != NULL) {
+    printf("%s", cData.quitMessage);
+  }
 
   // shut down the message module
   message_done();
+  reportPredictions(&cData);
+  reportLatency(&cData);
+  free(cData.frame);
+  free(cData.latest);
+  free(cData.view);
+  free(cData.terrain);
+  free(cData.cache);
+  free(cData.quitMessage);
+  pthread_cond_destroy(&cData.changed);
+  pthread_mutex_destroy(&cData.lock);
 
   return ok? 0 : 1; // status code depends on result of message_loop
 
@@ -189,23 +366,49 @@ static bool handleInput(void* arg) {
     return true;
   }
 
-  // initialze char and set buffersize of 12
+  // initialze char and set buffersize of 32
   char key;
-  const int messageSize = 12;
+  const int messageSize = 32;
+
+  // read a key from stdin, if not q; not with getch(), since curses is
+  // the render thread's alone
+  ssize_t nbytes = read(0, &key, 1);
+
+  // the spectator moves the view, not a player
+  if (nbytes == 1 && cData.spectator) {
+    pthread_mutex_lock(&cData.lock);
+    bool panned = panView(&cData, key);
+    if (panned) {
+      pthread_cond_signal(&cData.changed);
+    }
+    pthread_mutex_unlock(&cData.lock);
+    if (panned) {
+      return false;
+    }
+  }
 
-  // read a key from stdin, if not q
-  key = getch();
-  if (key != 'Q' && key != EOF) { 
+  if (nbytes == 1 && key != 'Q') { 
 
     // create a static char array to print into
     char message[messageSize];
    
-    // print into the array
-    snprintf(message, sizeof(message), "KEY %c", key);
+    // print into the array, numbered so we can time the reply
+    pthread_mutex_lock(&cData.lock);
+    unsigned long seq = ++cData.nextSeq;
+    snprintf(message, sizeof(message), "KEY %c %lu", key, seq);
+    cData.sentSeq[seq % MAXTRACES] = seq;
+    cData.sentAt[seq % MAXTRACES] = now();
+    pthread_mutex_unlock(&cData.lock);
 
     // send the message to the server
     message_send(*server, message);
 
+    // show the move straight away, without waiting for the server
+    pthread_mutex_lock(&cData.lock);
+    predictMove(&cData, key);
+    pthread_cond_signal(&cData.changed);
+    pthread_mutex_unlock(&cData.lock);
+
     // return false to indicate keep on looping
     return false;
 
@@ -215,10 +418,7 @@ static bool handleInput(void* arg) {
     // send q key to the server if client quit
     message_send(*server, "KEY Q");
     
-    // close the ncurses
-    endwin();
-    
-    // return true to keep looping
+    // return true to stop looping; main closes ncurses
     return true;
   }
 }
@@ -235,7 +435,8 @@ static bool handleInput(void* arg) {
  *  the client data depending on what it says
  * 
  * We return:
- *  a bool depending on if message loop should continue or not (always should)
+ *  a bool depending on if message loop should continue or not; it
+ *  stops once the server says QUIT
  */
 static bool handleMessage(void* arg, const addr_t from, const char* message) {
 
@@ -245,14 +446,62 @@ static bool handleMessage(void* arg, const addr_t from, const char* message) {
     return false; // keep listening
   }
 
+  // time any KEY this echoes
+  pthread_mutex_lock(&cData.lock);
+  noteTrace(&cData, message);
+  pthread_mutex_unlock(&cData.lock);
+
+  // handle DELTA message; it takes the lock only once it is decoded
+  bool quit = false;
+  if(strncmp(message, "DELTA ", strlen("DELTA ")) == 0) {
+    handleDELTA(message, from, &cData);
+  }
+  else {
+    pthread_mutex_lock(&cData.lock);
+    quit = handleOther(message, from);
+    cData.dirty = true;
+    pthread_mutex_unlock(&cData.lock);
+  }
+
+  // have the changes drawn once every message that has come in is
+  // handled, so a burst of them is drawn once
+  if (!message_isPending() || quit) {
+    pthread_mutex_lock(&cData.lock);
+    pthread_cond_signal(&cData.changed);
+    pthread_mutex_unlock(&cData.lock);
+  }
+  return quit;
+}
+
+/***************** handleOther() *****************/ 
+/* 
+ * Caller provides: 
+ *  a message other than DELTA, and where it came from; the lock
+ *  is held
+ * 
+ * We do: 
+ *  handle the message according to its type
+ * 
+ * We return:
+ *  true if it was QUIT, false if not
+ */
+static bool handleOther(const char* message, const addr_t from) {
+
   // handle GRID message
-  else if(strncmp(message, "GRID ", strlen("GRID ")) == 0) { 
+  if(strncmp(message, "GRID ", strlen("GRID ")) == 0) { 
     handleGRID(message, &cData);
+
+    // ask for only the changes from now on, unless NUGGETS_DELTA=0
+    const char* deltaString = getenv("NUGGETS_DELTA");
+    if (cData.cache != NULL && (deltaString == NULL || strcmp(deltaString, "0") != 0)) {
+      message_send(from, "MODE DELTA");
+    }
   } 
 
   // handle QUIT message
   else if (strncmp(message, "QUIT ", strlen("QUIT ")) == 0) {
     handleQUIT(message, &cData);
+    return true;
   } 
 
   // handle GOLD message
@@ -260,9 +509,11 @@ static bool handleMessage(void* arg, const addr_t from, const char* message) {
     handleGOLD(message, &cData);
   } 
 
-  // handle DISPLAY message
+  // handle DISPLAY message; once DELTAs come, they are what is current
   else if(strncmp(message, "DISPLAY", strlen("DISPLAY")) == 0) {
-    handleDISPLAY(message, &cData);
+    if (!cData.deltas) {
+      handleDISPLAY(message, &cData);
+    }
   } 
 
   // handle ERROR message
@@ -275,18 +526,322 @@ static bool handleMessage(void* arg, const addr_t from, const char* message) {
     handleOK(message, &cData);
   } 
   else {
-
-    // refresh the screen to show changes
-    refresh();
     
     // print invalid message if incoming message does not adhere to 
-    // any of the above conditions, print at bottom row
-    mvprintw(0,0, "Error: message does not have known formatting\n");
+    // any of the above conditions, on the status line
+    snprintf(cData.status, sizeof(cData.status),
+             "Error: message does not have known formatting");
+    cData.statusChanged = true;
 
   }
+  return false;
+}
 
-  refresh(); // refresh the screen to show changes
-  return false; // keep listening
+/***************** handleTimeout() *****************/ 
+/* 
+ * Caller provides: 
+ *  an arg (unused; the global is used like the other handlers)
+ * 
+ * We do: 
+ *  nothing, now that no key or message has come in for a while,
+ *  but look to see whether the game is over
+ * 
+ * We return:
+ *  true if it is, to stop listening, else false
+ */
+static bool handleTimeout(void* arg) {
+  pthread_mutex_lock(&cData.lock);
+  bool quitting = cData.quitting;
+  pthread_mutex_unlock(&cData.lock);
+  return quitting;
+}
+
+/***************** receiveMain() *****************/ 
+/* 
+ * Caller provides: 
+ *  the client data
+ * 
+ * We do: 
+ *  as the receive thread, handle messages from the server until it
+ *  says QUIT or the player quits; either way, tell the other threads
+ * 
+ * We return:
+ *  NULL
+ */
+static void* receiveMain(void* arg) {
+
+  clientData_t* cData = arg;
+  message_loop(cData, pollInterval, handleTimeout, NULL, handleMessage);
+
+  pthread_mutex_lock(&cData->lock);
+  cData->quitting = true;
+  pthread_cond_broadcast(&cData->changed);
+  pthread_mutex_unlock(&cData->lock);
+  return NULL;
+}
+
+/***************** renderMain() *****************/ 
+/* 
+ * Caller provides: 
+ *  the client data
+ * 
+ * We do: 
+ *  as the render thread, the only one to use curses, draw whatever
+ *  is newest each time something changes, but no more often than
+ *  minInterval. The lock is held while the changes go into curses'
+ *  copy of the screen, and let go while they are written out to the
+ *  terminal, which is the slow part, so that meanwhile messages are
+ *  still received and keys still sent
+ * 
+ * We return:
+ *  NULL
+ */
+static void* renderMain(void* arg) {
+
+  clientData_t* cData = arg;
+  pthread_mutex_lock(&cData->lock);
+  while (!cData->quitting) {
+
+    // wait for something to show; a resize only sets a flag, so look
+    // for one now and then
+    if (!cData->dirty && !resized) {
+      waitFor(cData, pollInterval);
+      continue;
+    }
+
+    // keep to the frame rate; what comes in meanwhile is drawn after
+    double time = now();
+    if (time - cData->lastRedraw < cData->minInterval) {
+      waitFor(cData, cData->lastRedraw + cData->minInterval - time);
+      continue;
+    }
+
+    checkResize(cData);
+    if (cData->statusChanged && !cData->tooSmall) {
+      move(0,0);
+      clrtoeol();
+      mvaddnstr(0,0, cData->status, COLS); // cut short rather than wrap
+      cData->statusChanged = false;
+    }
+
+    // the newest frame waits until the window is big enough
+    if (cData->latestPending && !cData->tooSmall) {
+      drawDisplay(cData);
+      cData->latestPending = false;
+    }
+    cData->dirty = false;
+    cData->lastRedraw = time;
+
+    pthread_mutex_unlock(&cData->lock);
+    refresh();
+    pthread_mutex_lock(&cData->lock);
+  }
+  pthread_mutex_unlock(&cData->lock);
+  return NULL;
+}
+
+/***************** waitFor() *****************/ 
+/* 
+ * Caller provides: 
+ *  the client data, with the lock held, and a time in seconds
+ * 
+ * We do: 
+ *  wait until something changes, or that long at most
+ * 
+ * We return:
+ *  void 
+ */
+static void waitFor(clientData_t* cData, const double seconds) {
+  struct timespec until;
+  clock_gettime(CLOCK_REALTIME, &until);
+  long nanos = until.tv_nsec + (long) (seconds * 1e9);
+  until.tv_sec += nanos / 1000000000;
+  until.tv_nsec = nanos % 1000000000;
+  pthread_cond_timedwait(&cData->changed, &cData->lock, &until);
+}
+
+/***************** onResize() *****************/ 
+/* 
+ * Caller provides: 
+ *  the signal (SIGWINCH)
+ * 
+ * We do: 
+ *  note that the terminal changed size; it is safe to do no more
+ *  in a signal handler
+ * 
+ * We return:
+ *  void 
+ */
+static void onResize(int sig) {
+  resized = 1;
+}
+
+/***************** checkResize() *****************/ 
+/* 
+ * Caller provides: 
+ *  the client data
+ * 
+ * We do: 
+ *  if the terminal was resized, or a GRID came, tell ncurses its size,
+ *  and start the screen over: the status line and the whole of the
+ *  newest frame are drawn again, or how big the window must be if it
+ *  is now too small
+ * 
+ * We return:
+ *  void 
+ */
+static void checkResize(clientData_t* cData) {
+
+  if (!resized) {
+    return;
+  }
+  resized = 0;
+
+  struct winsize size;
+  if (ioctl(fileno(stdout), TIOCGWINSZ, &size) == 0) {
+    resizeterm(size.ws_row, size.ws_col);
+  }
+  clear();
+  checkSize(cData);
+  if (!cData->tooSmall) {
+    cData->statusChanged = true;
+    cData->latestPending = cData->latest != NULL && cData->latest[0] != '\0';
+  }
+  cData->dirty = true;
+}
+
+/***************** checkSize() *****************/ 
+/* 
+ * Caller provides: 
+ *  the client data
+ * 
+ * We do: 
+ *  fit the view to the terminal: as much of the map as fits below the
+ *  status line, with room to remember what is drawn there. If the
+ *  terminal is smaller than minRows by minCols, say how big it must be
+ *  instead. Either way nothing on screen can be trusted to match the
+ *  frame any more
+ * 
+ * We return:
+ *  void 
+ */
+static void checkSize(clientData_t* cData) {
+
+  int nrows;
+  int ncols;
+  getmaxyx(stdscr, nrows, ncols);
+
+  bool wasTooSmall = cData->tooSmall;
+  cData->tooSmall = nrows < minRows || ncols < minCols;
+  if (cData->tooSmall) {
+    erase();
+    mvprintw(0,0, "Window size requirements: %d rows by %d cols\n",
+             minRows, minCols);
+    printw("Please resize your window; the game goes on meanwhile\n");
+  }
+  else {
+    if (wasTooSmall) {
+      erase();
+    }
+    cData->viewRows = cData->rows < nrows - 1 ? cData->rows : nrows - 1;
+    cData->viewCols = cData->cols < ncols ? cData->cols : ncols;
+    free(cData->frame);
+    cData->frame = malloc(cData->viewRows * cData->viewCols + 1);
+  }
+  cData->frameValid = false;
+}
+
+/***************** scrollView() *****************/ 
+/* 
+ * Caller provides: 
+ *  the client data and the map about to be drawn
+ * 
+ * We do: 
+ *  for a player, scroll the view so they stay at least a quarter of
+ *  the view from its edges (where the map allows); then keep the view
+ *  within the map
+ * 
+ * We return:
+ *  void 
+ */
+static void scrollView(clientData_t* cData, const char* map) {
+
+  const char* at = cData->spectator ? NULL : strchr(map, '@');
+  if (at != NULL) {
+    int width = cData->cols + 1;
+    int x = (at - map) % width;
+    int y = (at - map) / width;
+    int marginX = cData->viewCols / 4;
+    int marginY = cData->viewRows / 4;
+
+    if (x < cData->viewLeft + marginX) {
+      cData->viewLeft = x - marginX;
+    }
+    else if (x >= cData->viewLeft + cData->viewCols - marginX) {
+      cData->viewLeft = x - cData->viewCols + marginX + 1;
+    }
+    if (y < cData->viewTop + marginY) {
+      cData->viewTop = y - marginY;
+    }
+    else if (y >= cData->viewTop + cData->viewRows - marginY) {
+      cData->viewTop = y - cData->viewRows + marginY + 1;
+    }
+  }
+
+  if (cData->viewLeft > cData->cols - cData->viewCols) {
+    cData->viewLeft = cData->cols - cData->viewCols;
+  }
+  if (cData->viewLeft < 0) {
+    cData->viewLeft = 0;
+  }
+  if (cData->viewTop > cData->rows - cData->viewRows) {
+    cData->viewTop = cData->rows - cData->viewRows;
+  }
+  if (cData->viewTop < 0) {
+    cData->viewTop = 0;
+  }
+}
+
+/***************** panView() *****************/ 
+/* 
+ * Caller provides: 
+ *  the client data and a key the spectator pressed
+ * 
+ * We do: 
+ *  move the view a cell for each of hjklyubn, or half the view for
+ *  HJKLYUBN, and have it drawn again
+ * 
+ * We return:
+ *  true if the key was one of those, false if not
+ */
+static bool panView(clientData_t* cData, const char key) {
+
+  const char* keys = "hjklyubn";
+  const char* which = strchr(keys, tolower((unsigned char) key));
+  if (key == '\0' || which == NULL) {
+    return false;
+  }
+
+  static const int dx[] = { -1, 0, 0, 1, -1, 1, -1, 1 };
+  static const int dy[] = { 0, 1, -1, 0, -1, -1, 1, 1 };
+  int stepX = isupper((unsigned char) key) ? cData->viewCols / 2 : 1;
+  int stepY = isupper((unsigned char) key) ? cData->viewRows / 2 : 1;
+  cData->viewLeft += dx[which - keys] * stepX;
+  cData->viewTop += dy[which - keys] * stepY;
+
+  cData->latestPending = cData->latest != NULL && cData->latest[0] != '\0';
+  cData->dirty = true;
+  return true;
+}
+
+/***************** now() *****************/ 
+/* 
+ * returns the current time in seconds
+ */
+static double now(void) {
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
 }
 
 /***************** initializeTerminal() *****************/ 
@@ -307,6 +862,10 @@ static void initializeTerminal(void){
   cbreak(); 
   noecho(); 
   refresh(); 
+
+  // a resize only sets a flag, so neither it nor the user holds up
+  // the network
+  signal(SIGWINCH, onResize);
 }
 
 /***************** handleGRID() *****************/ 
@@ -331,35 +890,34 @@ static void handleGRID(const char* message, void* arg){
 
   sscanf(message, "GRID %d %d", &rows, &cols); // read in data from message
 
-  // initialize rows
-  int nrows;
-  int ncols;
-
-  // get current terminal size
-  getmaxyx(stdscr, nrows, ncols);
-
   // store needed size in cData
   cData->rows = rows;
   cData->cols = cols;
 
-  // while the size of the terminal is not larger than 
-  // the size of the grid + 1 (so we can display messages in bottom row)
-  while (nrows < rows + 1 || ncols < cols + 1){
-
-    // prompt user to increase size
-    printw("Window size requirements: %d rows by %d cols\n", rows+1, cols+1);
-    printw("Please resize your window and press any key to continue\n");
+  // start at the top left; the view is sized to the screen at the
+  // next redraw
+  cData->viewTop = 0;
+  cData->viewLeft = 0;
 
-    // re-get the after the user enters a key
-    getch();
-    getmaxyx(stdscr, nrows, ncols);
-    
-    // refresh screen
-    clear();
-    refresh();
+  // nothing is known of the map yet
+  free(cData->terrain);
+  cData->terrain = malloc(rows * (cols + 1));
+  if (cData->terrain != NULL) {
+    memset(cData->terrain, ' ', rows * (cols + 1));
   }
-  
-  refresh(); // refresh screen to show changes
+  cData->confirmedAt = -1;
+  cData->numPredicted = 0;
+
+  // and DELTAs start again from a blank map
+  free(cData->cache);
+  cData->cache = malloc(strlen(displayHeader) + rows * (cols + 1) + 1);
+  cData->deltas = false;
+  cData->resyncing = false;
+
+  // fit the view to the screen, below the status line, as after a
+  // resize; if the terminal is too small even for that, we keep playing
+  // but show only how big it needs to be
+  resized = 1;
 }
 
 /***************** handleGOLD() *****************/ 
@@ -389,30 +947,27 @@ static void handleGOLD(const char* message, void* arg){
   cData->nuggets = nuggets;
 
   if (cData->spectator) { // if client is spectator, only print remaining nuggets
-    move(0,0);
-    // print spectator message about unclaimed nuggets in first row
-    mvprintw(0,0, "Spectator: %d nuggets unclaimed", remaining);
-    refresh();  
-
+    // spectator message about unclaimed nuggets
+    snprintf(cData->status, sizeof(cData->status),
+             "Spectator: %d nuggets unclaimed", remaining);
   }
   // if player did not pick up any nuggets on this message, print 
-  // status with unclaimed on first row
+  // status with unclaimed
   else if (cData->nuggets == 0) {  
-    move(0,0);
-    // print player message about current nuggets, and remaining nuggets 
-    mvprintw(0,0, "Player %c has %d nuggets (%d nuggets unclaimed)", cData->id, purse, remaining);
-    refresh();  
+    // player message about current nuggets, and remaining nuggets 
+    snprintf(cData->status, sizeof(cData->status),
+             "Player %c has %d nuggets (%d nuggets unclaimed)", cData->id, purse, remaining);
   }
 
-  // player did pick up nuggets so we have to display to them as well so 
-  // print status with unclaimed on first row
+  // player did pick up nuggets so we have to display to them as well
   else {
-    move(0,0);
-    // print player message about current nuggets, and remaining nuggets and the GOLD nuggets they recieved
-    mvprintw(0,0, "Player %c has %d nuggets (%d nuggets unclaimed). GOLD received:    ", cData->id, purse, remaining);
-    mvprintw(0,0, "Player %c has %d nuggets (%d nuggets unclaimed). GOLD received: %d  ", cData->id, purse, remaining, nuggets);
-    refresh();
+    // player message about current nuggets, and remaining nuggets and the GOLD nuggets they recieved
+    snprintf(cData->status, sizeof(cData->status),
+             "Player %c has %d nuggets (%d nuggets unclaimed). GOLD received: %d", cData->id, purse, remaining, nuggets);
   } 
+
+  // drawn in the first row at the next redraw
+  cData->statusChanged = true;
 }
 
 
@@ -422,29 +977,23 @@ static void handleGOLD(const char* message, void* arg){
  *  message from the server and cData as arg
  * 
  * We do: 
- *  end the game by shutting down ncurses, then printing
- *  the message to stdout
+ *  end the game: keep the message, for main to print to stdout once
+ *  it has shut down ncurses, and tell every thread to stop
  * 
  * We return:
- *  void (but we exit success if handleQUIT called)
+ *  void
  */
 static void handleQUIT(const char* message, void *arg){
 
-  // copy message to edit
-  char* messageCopy = malloc(strlen(message) + 1); 
-  strcpy(messageCopy, message);
-
-  // get the map by incrementing the pointer to the message
-  // and skipping the prefix
-  char* quitMessage = messageCopy + strlen("QUIT ");  
-
-  // end the game
-  clear(); // clear the screen
-  nocbreak(); // get rid of continuous input
-  endwin(); // end the ncurses window
-  printf("%s", quitMessage); // print the QUIT message
-  free(messageCopy);
-  exit(0); // exit successfully
+  clientData_t* cData = (clientData_t*) arg;
+
+  // skip the prefix
+  free(cData->quitMessage);
+  cData->quitMessage = malloc(strlen(message) + 1);
+  if (cData->quitMessage != NULL) {
+    strcpy(cData->quitMessage, message + strlen("QUIT "));
+  }
+  cData->quitting = true;
 }
 
 /***************** handleERROR() *****************/ 
@@ -471,8 +1020,9 @@ static void handleERROR(const char* message){
  *  message from the server and cData as arg
  * 
  * We do: 
- *  print the grid in the messsage recieved from the server 
- *  to the display using ncurses
+ *  keep the grid in the messsage recieved from the server, to be
+ *  drawn when the screen is next redrawn; any older one not yet
+ *  drawn is dropped
  * 
  * We return:
  *  void 
@@ -482,56 +1032,388 @@ static void handleDISPLAY(const char* message, void* arg){
   // cast the arg to cData
   clientData_t* cData = (clientData_t*) arg;
 
-  // copy message to edit
-  char* messageCopy = malloc(strlen(message) + 1); 
-  strcpy(messageCopy, message);
+  // messages are never longer than the buffer; any trace of a KEY
+  // on the first line has been noted, so leave it out
+  const char* map = strchr(message, '\n');
+  strcpy(cData->latest, displayHeader);
+  strcat(cData->latest, map == NULL ? "" : map + 1);
+  reconcile(cData);
+  makeView(cData);
+  cData->latestPending = true;
+}
 
-  // get the map by incrementing the pointer to the message
-  // and skipping the prefix
-  char* map = messageCopy + strlen("DISPLAY\n");  
+/***************** handleDELTA() *****************/ 
+/* 
+ * Caller provides: 
+ *  the DELTA message, the server's address and the client data
+ * 
+ * We do: 
+ *  write the changed cells into our copy of the map, without the
+ *  lock, then take it to handle the map as if it had come as a
+ *  DISPLAY; DELTA 1 starts from a blank
+ *  map. If one went missing (the number skips) the map is out of
+ *  date, so ask the server to start over with MODE DELTA, and
+ *  ignore DELTAs until its new DELTA 1 comes
+ * 
+ * We return:
+ *  void 
+ */
+static void handleDELTA(const char* message, const addr_t from, void* arg) {
 
-  // varaiables for looping
-  int cols = cData->cols; // cols needed for the  grid
-  int y = 1;  // starts out as 1 because 0th row is reserved for status
-	int x = 0; 
-	int j = 0;  // counter of what column we are at
+  // cast the arg to cData
+  clientData_t* cData = (clientData_t*) arg;
+  if (cData->cache == NULL) {
+    return; // no GRID yet
+  }
 
-	// loop through the map
-	for (int i = 0; map[i] != '\0'; i++) {
-    
-    // check if at the end of a line or at the end of screen
-		if (map[i] == '\n' || j >= cols) {
+  unsigned int number;
+  const char* lines = strchr(message, '\n');
+  if (sscanf(message, "DELTA %u", &number) != 1 || lines == NULL) {
+    return;
+  }
+  lines++;
+
+  char* map = cData->cache + strlen(displayHeader);
+  if (number == 1) {
+    strcpy(cData->cache, displayHeader);
+    delta_blank(map, cData->rows, cData->cols);
+    cData->resyncing = false;
+  } else if (cData->resyncing) {
+    return; // waiting for DELTA 1
+  } else if (number != cData->deltaNumber + 1) {
+    // we missed one; start over
+    message_send(from, "MODE DELTA");
+    cData->resyncing = true;
+    return;
+  }
+  cData->deltaNumber = number;
+  cData->deltas = true;
+
+  if (!delta_apply(map, cData->rows, cData->cols, lines)) {
+    message_send(from, "MODE DELTA");
+    cData->resyncing = true;
+    return;
+  }
+
+  // only now is anything shared touched
+  pthread_mutex_lock(&cData->lock);
+  handleDISPLAY(cData->cache, cData);
+  cData->dirty = true;
+  pthread_mutex_unlock(&cData->lock);
+}
+
+/***************** predictMove() *****************/ 
+/* 
+ * Caller provides: 
+ *  the client data and a key just sent to the server
+ * 
+ * We do: 
+ *  if the key moves us one step onto a spot we know we can stand on,
+ *  show us there at once, ahead of the server's DISPLAY; the server
+ *  has the last word (see reconcile)
+ * 
+ * We return:
+ *  void 
+ */
+static void predictMove(clientData_t* cData, const char key) {
+
+  // only a player who has been shown where they are can move
+  if (cData->spectator || cData->terrain == NULL || cData->confirmedAt < 0
+                       || cData->numPredicted == MAXPREDICTIONS) {
+    return;
+  }
+
+  // long moves (capital letters) are left to the server
+  int dx = 0;
+  int dy = 0;
+  switch (key) {
+    case 'h': dx = -1;          break;
+    case 'l': dx =  1;          break;
+    case 'j':          dy =  1; break;
+    case 'k':          dy = -1; break;
+    case 'y': dx = -1; dy = -1; break;
+    case 'u': dx =  1; dy = -1; break;
+    case 'b': dx = -1; dy =  1; break;
+    case 'n': dx =  1; dy =  1; break;
+    default: return;
+  }
+
+  // step from where we are shown to be
+  int width = cData->cols + 1;
+  int from = cData->numPredicted > 0 ? cData->predicted[cData->numPredicted - 1]
+                                     : cData->confirmedAt;
+  int x = from % width + dx;
+  int y = from / width + dy;
+  if (x < 0 || x >= cData->cols || y < 0 || y >= cData->rows) {
+    return;
+  }
+
+  // we can step onto a room spot, passage or gold, but not onto another
+  // player; moving them is for the server to decide
+  int to = y * width + x;
+  const char* map = cData->latest + strlen("DISPLAY\n");
+  char spot = cData->terrain[to];
+  if (isupper(map[to]) || (spot != '.' && spot != '#' && spot != '*')) {
+    return;
+  }
+  if (spot == '*') {
+    cData->terrain[to] = '.'; // we will pick it up
+  }
+
+  cData->predicted[cData->numPredicted++] = to;
+  cData->numPredictions++;
+  makeView(cData);
+  cData->latestPending = true;
+  cData->dirty = true;
+}
+
+/***************** reconcile() *****************/ 
+/* 
+ * Caller provides: 
+ *  the client data, with a new DISPLAY from the server in latest
+ * 
+ * We do: 
+ *  learn the terrain it shows, and check where it shows us against
+ *  the moves we predicted: moves up to there are confirmed; if it is
+ *  none of them (and we have moved) the predictions were wrong, so
+ *  they are counted as a mismatch and dropped
+ * 
+ * We return:
+ *  void 
+ */
+static void reconcile(clientData_t* cData) {
 
-			// reset back to left of line, but go one line down
-			y++;
-			x = 0;
-			j = 0; // reset cols
+  if (cData->terrain == NULL || strlen(cData->latest) < strlen("DISPLAY\n")) {
+    return;
+  }
 
-		} 
-    else {
-      
-			// add char at the x and y and mv there
-			mvaddch(y, x, map[i]);
+  // remember what every cell holds, except for players on it
+  const char* map = cData->latest + strlen("DISPLAY\n");
+  int length = cData->rows * (cData->cols + 1);
+  int at = -1;
+  for (int i = 0; i < length && map[i] != '\0'; i++) {
+    if (map[i] == '@') {
+      at = i;
+    } else if (!isupper(map[i])) {
+      cData->terrain[i] = map[i];
+    }
+  }
+  if (at < 0) {
+    return; // a spectator, or nobody to be seen
+  }
+  if (cData->terrain[at] == '*') {
+    cData->terrain[at] = '.'; // the server has given us the gold there
+  }
 
-      // increment the currentX and the column we are on
-			x++;
-			j++;
+  // the frame may answer one of our moves, or come from someone else's
+  int confirmed = -1;
+  for (int k = 0; k < cData->numPredicted; k++) {
+    if (cData->predicted[k] == at) {
+      confirmed = k;
+    }
+  }
+  if (confirmed >= 0) {
+    cData->numPredicted -= confirmed + 1;
+    memmove(cData->predicted, cData->predicted + confirmed + 1,
+            cData->numPredicted * sizeof(int));
+  } else if (cData->numPredicted > 0 && at != cData->confirmedAt) {
+    cData->numMismatches++;
+    cData->numPredicted = 0;
+  }
+  cData->confirmedAt = at;
+}
 
-		}
+/***************** makeView() *****************/ 
+/* 
+ * Caller provides: 
+ *  the client data
+ * 
+ * We do: 
+ *  copy the newest DISPLAY into view, moving us to where our latest
+ *  unconfirmed move puts us, and showing what we left behind
+ * 
+ * We return:
+ *  void 
+ */
+static void makeView(clientData_t* cData) {
 
-    // check if at newline, if so reset to start
-		if (map[i] == '\n') { 
-			j = 0;
-		}
-	}
+  strcpy(cData->view, cData->latest);
+  if (cData->numPredicted == 0 || cData->confirmedAt < 0) {
+    return;
+  }
 
-	// refresh screen
-	refresh();                              
+  // a player spawns on a room spot, so that is what an unknown cell
+  // under us must be
+  char* map = cData->view + strlen("DISPLAY\n");
+  char left = cData->terrain[cData->confirmedAt];
+  map[cData->confirmedAt] = left == ' ' ? '.' : left;
+  map[cData->predicted[cData->numPredicted - 1]] = '@';
+}
 
-  // free messageCopy
-  free(messageCopy);
+/***************** noteTrace() *****************/ 
+/* 
+ * Caller provides: 
+ *  the client data and a message from the server
+ * 
+ * We do: 
+ *  if its first line ends with the echo of one of our KEYs,
+ *  " seq received sent", and it is the first for that KEY, say on
+ *  stderr how long the KEY took there and back, and how much of that
+ *  was in the server (sent - received, by the server's clock) and so
+ *  how much on the network
+ * 
+ * We return:
+ *  void 
+ */
+static void noteTrace(clientData_t* cData, const char* message) {
+
+  unsigned long seq;
+  long long received, sent;
+  if (!delta_parseTrace(message, &seq, &received, &sent)
+      || cData->sentSeq[seq % MAXTRACES] != seq
+      || cData->sentAt[seq % MAXTRACES] == 0) {
+    return; // not ours, or already timed
+  }
 
+  double roundTrip = now() - cData->sentAt[seq % MAXTRACES];
+  double inServer = (sent - received) / 1e6;
+  cData->sentAt[seq % MAXTRACES] = 0;
+  cData->numTraced++;
+  cData->totalRoundTrip += roundTrip;
+  cData->totalServer += inServer;
+  fprintf(stderr, "KEY %lu: %.3f ms there and back, %.3f ms in the server, "
+          "%.3f ms on the network\n", seq, roundTrip * 1000, inServer * 1000,
+          (roundTrip - inServer) * 1000);
+}
 
+/***************** reportLatency() *****************/ 
+/* 
+ * Caller provides: 
+ *  the client data
+ * 
+ * We do: 
+ *  say on stderr how long KEYs took on average, and where
+ * 
+ * We return:
+ *  void 
+ */
+static void reportLatency(clientData_t* cData) {
+  if (cData->numTraced > 0) {
+    fprintf(stderr, "%d keys took %.3f ms on average: %.3f ms in the server, "
+            "%.3f ms on the network\n", cData->numTraced,
+            cData->totalRoundTrip / cData->numTraced * 1000,
+            cData->totalServer / cData->numTraced * 1000,
+            (cData->totalRoundTrip - cData->totalServer) / cData->numTraced * 1000);
+  }
+}
+
+/***************** reportPredictions() *****************/ 
+/* 
+ * Caller provides: 
+ *  the client data
+ * 
+ * We do: 
+ *  say on stderr (usually the log) how well our moves were predicted
+ * 
+ * We return:
+ *  void 
+ */
+static void reportPredictions(clientData_t* cData) {
+  if (cData->numPredictions > 0) {
+    fprintf(stderr, "predicted %d moves; %d times the server disagreed\n",
+            cData->numPredictions, cData->numMismatches);
+  }
+}
+
+/***************** drawDisplay() *****************/ 
+/* 
+ * Caller provides: 
+ *  the client data, holding the newest DISPLAY message
+ * 
+ * We do: 
+ *  print the part of its grid in the view using ncurses, redrawing
+ *  only what differs from the frame drawn last time; the cost goes with
+ *  the size of the screen, however big the map
+ * 
+ * We return:
+ *  void 
+ */
+static void drawDisplay(clientData_t* cData){
+
+  // get the map by skipping the prefix, if there is one
+  if (strlen(cData->view) < strlen("DISPLAY\n") || cData->frame == NULL) {
+    return;
+  }
+  const char* map = cData->view + strlen("DISPLAY\n");  
+  int mapLength = strlen(map);
+  scrollView(cData, map);
+
+  // nothing on screen can be trusted, so compare against what can never
+  // be there and every cell is drawn
+  int viewCols = cData->viewCols;
+  if (!cData->frameValid) {
+    memset(cData->frame, '\0', cData->viewRows * viewCols);
+  }
+
+  // row 0 is reserved for status
+  for (int y = 0; y < cData->viewRows; y++) {
+
+    // the part of this row of the map in the view, if the map has it
+    int start = (cData->viewTop + y) * (cData->cols + 1);
+    const char* line = map + (start < mapLength ? start : mapLength);
+    const char* end = strchr(line, '\n');
+    int length = end == NULL ? strlen(line) : end - line;
+    length -= cData->viewLeft;
+    length = length < 0 ? 0 : (length < viewCols ? length : viewCols);
+    line += length > 0 ? cData->viewLeft : 0;
+
+    // one that matches what is on screen is left alone
+    char* drawn = cData->frame + y * viewCols;
+    if (length < viewCols || memcmp(drawn, line, viewCols) != 0) {
+      drawRow(line, drawn, length, viewCols, y + 1);
+    }
+  }
+  cData->frameValid = true;
+}
+
+/***************** drawRow() *****************/ 
+/* 
+ * Caller provides: 
+ *  a line of the new map, the same row as last drawn (cols chars),
+ *  how many chars of the line to show, the width of the grid,
+ *  and the screen row
+ * 
+ * We do: 
+ *  redraw each run of chars that differs from what was drawn,
+ *  and remember the new row; the rest of the row is blanked
+ * 
+ * We return:
+ *  void 
+ */
+static void drawRow(const char* line, char* drawn, const int length,
+                    const int cols, const int y){
+
+  int x = 0;
+  while (x < cols) {
+
+    // skip over what is already on screen
+    char want = x < length ? line[x] : ' ';
+    if (drawn[x] == want) {
+      x++;
+      continue;
+    }
+
+    // find the end of this run of changes
+    int start = x;
+    while (x < cols && drawn[x] != (x < length ? line[x] : ' ')) {
+      drawn[x] = x < length ? line[x] : ' ';
+      x++;
+    }
+    move(y, start);
+    for (int i = start; i < x; i++) {
+      addch(drawn[i]);
+    }
+  }
 }
 
 /***************** handleOK() *****************/ 
@@ -8,11 +8,16 @@
  * 2. Variants that 'assert' the result is non-NULL;
  *    if NULL occurs, kick out an error and die.
  *
+ * 3. A profiler that splits those counts, and the bytes asked for,
+ *    between named phases of the program.
+ *
  * David Kotz, April 2016, 2017, 2019, 2021
+ * Ribhu Hooja, March 2024 - added the phase profiler
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "mem.h"
 
 /**************** file-local global variables ****************/
@@ -21,6 +26,26 @@ static int nmalloc = 0;         // number of successful malloc calls
 static int nfree = 0;           // number of free calls
 static int nfreenull = 0;       // number of free(NULL) calls
 
+// the allocation profile of one phase
+typedef struct phase {
+  const char* name;             // name given to mem_phasePush
+  int nmalloc;                  // number of successful malloc calls
+  size_t nbytes;                // bytes asked for by those calls
+  int nfree;                    // number of free calls
+} phase_t;
+
+static phase_t phases[16] = { { "other", 0, 0, 0 } };
+static const int maxPhases = 16;  // size of phases[]
+static int nphases = 1;           // phases[0] is "other"
+static int phaseStack[8];         // index into phases[] of each pushed phase
+static const int maxDepth = 8;    // size of phaseStack[]
+static int depth = 0;             // number of pushes not yet popped
+static int current = 0;           // index into phases[] of the innermost phase
+
+/**************** local functions ****************/
+static void countMalloc(const size_t size);
+static phase_t* findPhase(const char* name);
+
 
 /**************** mem_assert ****************/
 /* see mem.h for description */
@@ -56,7 +81,7 @@ mem_malloc_assert(const size_t size, const char* message)
     fprintf(stderr, "Out of memory: %s\n", message);
     exit (99);
   }
-  nmalloc++;
+  countMalloc(size);
   return ptr;
 }
 
@@ -68,7 +93,7 @@ mem_malloc(const size_t size)
 {
   void* ptr = malloc(size);
   if (ptr != NULL) {
-    nmalloc++;
+    countMalloc(size);
   }
   return ptr;
 }
@@ -79,7 +104,7 @@ void*
 mem_calloc_assert(const size_t nmemb, const size_t size, const char* message)
 {
   void* ptr = mem_assert(calloc(nmemb, size), message);
-  nmalloc++;
+  countMalloc(nmemb * size);
   return ptr;
 }
 
@@ -90,7 +115,7 @@ mem_calloc(const size_t nmemb, const size_t size)
 {
   void* ptr = calloc(nmemb, size);
   if (ptr != NULL) {
-    nmalloc++;
+    countMalloc(nmemb * size);
   }
   return ptr;
 }
@@ -103,6 +128,7 @@ mem_free(void* ptr)
   if (ptr != NULL) {
     free(ptr);
     nfree++;
+    phases[current].nfree++;
   } else {
     // it's an error to call free(NULL)!
     nfreenull++;
@@ -125,3 +151,107 @@ mem_net(void)
 {
   return nmalloc - nfree - nfreenull;
 }
+
+/**************** mem_phasePush() ****************/
+/* see mem.h for description */
+void
+mem_phasePush(const char* name)
+{
+  if (name == NULL) {
+    return;
+  }
+
+  // too deep: keep counting against the enclosing phase
+  if (depth < maxDepth) {
+    phase_t* phase = findPhase(name);
+    if (phase == NULL && nphases < maxPhases) {
+      phase = &phases[nphases++];
+      phase->name = name;
+      phase->nmalloc = 0;
+      phase->nbytes = 0;
+      phase->nfree = 0;
+    }
+    if (phase != NULL) {
+      current = phase - phases;
+    }
+    phaseStack[depth] = current;
+  }
+  depth++;
+}
+
+/**************** mem_phasePop() ****************/
+/* see mem.h for description */
+void
+mem_phasePop(void)
+{
+  if (depth == 0) {
+    return;
+  }
+
+  depth--;
+  if (depth == 0) {
+    current = 0;
+  } else if (depth <= maxDepth) {
+    current = phaseStack[depth - 1];
+  }
+}
+
+/**************** mem_phaseReport() ****************/
+/* see mem.h for description */
+void
+mem_phaseReport(FILE* fp)
+{
+  if (fp == NULL) {
+    return;
+  }
+
+  for (int i = 0; i < nphases; i++) {
+    fprintf(fp, "%s: %d malloc, %zu bytes, %d free\n",
+            phases[i].name, phases[i].nmalloc, phases[i].nbytes, phases[i].nfree);
+  }
+}
+
+/**************** mem_phaseMallocs() ****************/
+/* see mem.h for description */
+int
+mem_phaseMallocs(const char* name)
+{
+  phase_t* phase = findPhase(name);
+  return phase == NULL ? 0 : phase->nmalloc;
+}
+
+/**************** mem_phaseBytes() ****************/
+/* see mem.h for description */
+size_t
+mem_phaseBytes(const char* name)
+{
+  phase_t* phase = findPhase(name);
+  return phase == NULL ? 0 : phase->nbytes;
+}
+
+/**************** countMalloc() ****************/
+/* Count one successful allocation of the given size. */
+static void
+countMalloc(const size_t size)
+{
+  nmalloc++;
+  phases[current].nmalloc++;
+  phases[current].nbytes += size;
+}
+
+/**************** findPhase() ****************/
+/* Return the phase with the given name, or NULL if there is none yet. */
+static phase_t*
+findPhase(const char* name)
+{
+  if (name == NULL) {
+    return NULL;
+  }
+
+  for (int i = 0; i < nphases; i++) {
+    if (strcmp(phases[i].name, name) == 0) {
+      return &phases[i];
+    }
+  }
+  return NULL;
+}
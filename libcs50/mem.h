@@ -113,4 +113,48 @@ void mem_report(FILE* fp, const char* message);
  */
 int mem_net(void);
 
+/**************** mem_phasePush() ****************/
+/* Start counting allocations against a named phase of the program.
+ * We assume:
+ *   caller provides the phase name; it is compared with strcmp, and the
+ *   pointer is kept, so it should be a string constant.
+ * We do:
+ *   count every later mem_malloc/calloc and mem_free against that phase,
+ *   until the matching mem_phasePop. Phases nest; only the innermost one
+ *   counts. Allocations outside any phase count against phase "other".
+ * Notes:
+ *   Up to 16 different phases, nested up to 8 deep. Beyond either limit,
+ *   allocations count against the enclosing phase.
+ */
+void mem_phasePush(const char* name);
+
+/**************** mem_phasePop() ****************/
+/* Stop counting allocations against the innermost phase, going back to
+ * the one that enclosed it.
+ */
+void mem_phasePop(void);
+
+/**************** mem_phaseReport() ****************/
+/* Print the allocation profile, one line per phase.
+ * We assume:
+ *   caller provides a FILE open for writing.
+ * We print, for every phase seen so far, the number of calls to
+ * mem_malloc/calloc, the number of bytes they asked for, and the number
+ * of calls to mem_free. Direct calls to malloc, calloc and free are not
+ * counted.
+ */
+void mem_phaseReport(FILE* fp);
+
+/**************** mem_phaseMallocs() ****************/
+/* Return the number of mem_malloc/calloc calls made in a phase so far,
+ * or 0 if there is no such phase.
+ */
+int mem_phaseMallocs(const char* name);
+
+/**************** mem_phaseBytes() ****************/
+/* Return the number of bytes asked for by mem_malloc/calloc calls made in
+ * a phase so far, or 0 if there is no such phase.
+ */
+size_t mem_phaseBytes(const char* name);
+
 #endif // __MEM_H
@@ -0,0 +1,169 @@
+/*
+ * a file to test that handling keystrokes does not allocate memory
+ *
+ * Plays a scripted game through the game module, the way the server does.
+ * The test is linked with --wrap for malloc, calloc and realloc, so every
+ * allocation made by the modules (not just those through mem_) is counted.
+ * Once the game has warmed up, no KEY may allocate anything; if one does,
+ * the test says which and exits with a nonzero status.
+ *
+ * Also prints the mem_ allocation profile of each phase of the game.
+ *
+ * Ribhu Hooja, March 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "game.h"
+#include "player.h"
+#include "grid.h"
+#include "message.h"
+#include "mem.h"
+
+/****************** file-local global constants **********/
+static const int numPlayers = 4;
+static const int numWarmUpKeys = 20;    // enough for snapshots to be recycled
+static const int numKeys = 2000;
+static const char* keys = "hjklyubnHJKLYUBN";
+
+/****************** file-local global variables **********/
+// allocations made through the wrapped functions, from any thread
+static atomic_long numAllocations = 0;
+
+/****************** allocation wrappers ******************/
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t nmemb, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size)
+{
+  atomic_fetch_add(&numAllocations, 1);
+  return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t nmemb, size_t size)
+{
+  atomic_fetch_add(&numAllocations, 1);
+  return __real_calloc(nmemb, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+  atomic_fetch_add(&numAllocations, 1);
+  return __real_realloc(ptr, size);
+}
+
+/****************** local functions **********************/
+static bool pressKey(game_t* game, addr_t from, const char key);
+
+/****************** main *********************************/
+int
+main()
+{
+  srand(42);
+
+  FILE* fp = fopen("../maps/main.txt", "r");
+  if (fp == NULL){
+    fprintf(stderr, "could not open ../maps/main.txt\n");
+    return 2;
+  }
+  game_t* game = game_init(fp, 0);
+  fclose(fp);
+
+  // no log; messages go to ports nobody is listening on
+  if (message_init(NULL) == 0){
+    return 2;
+  }
+  addr_t addresses[numPlayers];
+
+  mem_phasePush("join");
+  for (int i = 0; i < numPlayers; ++i){
+    char port[10];
+    snprintf(port, sizeof(port), "%d", 10001 + i);
+    message_setAddr("127.0.0.1", port, &addresses[i]);
+
+    int x, y;
+    grid_findRandomSpawnPosition(game_masterGrid(game), &x, &y);
+    player_t* player = player_new(game_getPlayers(game), addresses[i], x, y,
+                                  "player", 'A' + i);
+    game_addPlayer(game, player);
+  }
+  game_addSpectator(game, addresses[0]);
+  mem_phasePop();
+
+  // the first few broadcasts make the snapshots that later ones reuse
+  bool gameOver = false;
+  mem_phasePush("warm up");
+  for (int i = 0; i < numWarmUpKeys && !gameOver; ++i){
+    gameOver = pressKey(game, addresses[rand() % numPlayers], keys[rand() % 16]);
+  }
+  mem_phasePop();
+
+  int numKeysPressed = 0;
+  int numBadKeys = 0;
+  mem_phasePush("key");
+  for (int i = 0; i < numKeys && !gameOver; ++i){
+    char key = keys[rand() % 16];
+    long before = atomic_load(&numAllocations);
+    gameOver = pressKey(game, addresses[rand() % numPlayers], key);
+    long allocations = atomic_load(&numAllocations) - before;
+
+    // the key that ends the game is allowed to clean up
+    if (allocations != 0 && !gameOver){
+      printf("KEY %c (number %d) made %ld allocations\n", key, i, allocations);
+      ++numBadKeys;
+    }
+    ++numKeysPressed;
+  }
+  mem_phasePop();
+
+  if (!gameOver){
+    game_over(game);
+  }
+  message_done();
+
+  printf("\nAllocation profile (mem_ calls only):\n");
+  mem_phaseReport(stdout);
+  mem_report(stdout, "overall");
+
+  printf("\n%d keys pressed after warming up\n", numKeysPressed);
+  if (numBadKeys > 0 || mem_phaseMallocs("key") > 0){
+    printf("FAIL: %d keys allocated memory\n", numBadKeys);
+    return 1;
+  }
+
+  printf("PASS: no key allocated memory\n");
+  return 0;
+}
+
+/****************** pressKey *****************************
+ *
+ * handles a KEY from a player the way the server does, returning
+ * whether the game is over
+ *
+ */
+static bool
+pressKey(game_t* game, addr_t from, const char key)
+{
+  game_resetScratch(game);
+
+  int dx = 0;
+  int dy = 0;
+  switch (key){
+    case 'h': case 'H': dx = -1;          break;
+    case 'l': case 'L': dx =  1;          break;
+    case 'j': case 'J':          dy =  1; break;
+    case 'k': case 'K':          dy = -1; break;
+    case 'y': case 'Y': dx = -1; dy = -1; break;
+    case 'u': case 'U': dx =  1; dy = -1; break;
+    case 'b': case 'B': dx = -1; dy =  1; break;
+    case 'n': case 'N': dx =  1; dy =  1; break;
+  }
+
+  if (key >= 'A' && key <= 'Z'){
+    return game_longMove(game, from, dx, dy);
+  }
+  return game_move(game, from, dx, dy);
+}
@@ -0,0 +1,163 @@
+/*
+ * arena.c - a file implementing the arena module for
+ * the cs50 nuggets game
+ *
+ * usage and description is given in arena.h
+ *
+ * The arena is a list of blocks, each filled from the front. Allocating
+ * bumps an offset into the current block, moving on to the next block (or
+ * making a new one) when it is full. Resetting goes back to the first
+ * block; blocks are only given back to the system by arena_delete.
+ *
+ * Ribhu Hooja, March 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+#include "mem.h"
+
+/****************** types ********************************/
+typedef struct block {
+  struct block* next;   // the next block in the arena
+  size_t size;          // number of usable bytes in this block
+  size_t used;          // number of bytes handed out from this block
+  max_align_t data[];   // the bytes themselves
+} block_t;
+
+typedef struct arena {
+  size_t blockSize;     // usable size of an ordinary block
+  block_t* first;       // the first block; NULL until the first allocation
+  block_t* current;     // the block being allocated from
+} arena_t;
+
+/****************** file-local global constants **********/
+// every allocation is rounded up to a multiple of this
+static const size_t alignment = sizeof(max_align_t);
+
+/****************** local function prototypes ************/
+static block_t* newBlock(const size_t size);
+
+/****************** arena_new *****************************
+ *
+ * see arena.h for usage and description
+ *
+ */
+arena_t*
+arena_new(const size_t blockSize)
+{
+  if (blockSize == 0){
+    return NULL;
+  }
+
+  arena_t* arena = mem_malloc_assert(sizeof(arena_t), "out of memory; could not create arena\n");
+  arena->blockSize = blockSize;
+  arena->first = NULL;
+  arena->current = NULL;
+
+  return arena;
+}
+
+/****************** arena_alloc ***************************
+ *
+ * see arena.h for usage and description
+ *
+ */
+void*
+arena_alloc(arena_t* arena, const size_t size)
+{
+  if (arena == NULL || size == 0){
+    return NULL;
+  }
+
+  size_t rounded = (size + alignment - 1) / alignment * alignment;
+
+  // find the first block, from the current one on, with room for it;
+  // blocks after the current one were only left empty by a reset
+  block_t* block = arena->current;
+  while (block != NULL && block->size - block->used < rounded){
+    block = block->next;
+    if (block != NULL){
+      block->used = 0;
+    }
+  }
+
+  // none has room, so add a new block after the last one
+  if (block == NULL){
+    block = newBlock(rounded > arena->blockSize ? rounded : arena->blockSize);
+    if (arena->first == NULL){
+      arena->first = block;
+    } else {
+      block_t* last = arena->current;
+      while (last->next != NULL){
+        last = last->next;
+      }
+      last->next = block;
+    }
+  }
+
+  arena->current = block;
+  void* result = (char*) block->data + block->used;
+  block->used += rounded;
+
+  memset(result, 0, size);
+  return result;
+}
+
+/****************** arena_reset ***************************
+ *
+ * see arena.h for usage and description
+ *
+ */
+void
+arena_reset(arena_t* arena)
+{
+  if (arena == NULL){
+    return;
+  }
+
+  // the later blocks are emptied as arena_alloc moves on to them
+  arena->current = arena->first;
+  if (arena->first != NULL){
+    arena->first->used = 0;
+  }
+}
+
+/****************** arena_delete **************************
+ *
+ * see arena.h for usage and description
+ *
+ */
+void
+arena_delete(arena_t* arena)
+{
+  if (arena == NULL){
+    return;
+  }
+
+  block_t* block = arena->first;
+  while (block != NULL){
+    block_t* next = block->next;
+    mem_free(block);
+    block = next;
+  }
+
+  mem_free(arena);
+}
+
+/****************** newBlock ******************************
+ *
+ * allocates an empty block with room for size bytes
+ *
+ */
+static block_t*
+newBlock(const size_t size)
+{
+  block_t* block = mem_malloc_assert(sizeof(block_t) + size, "out of memory; could not grow arena\n");
+  block->next = NULL;
+  block->size = size;
+  block->used = 0;
+
+  return block;
+}
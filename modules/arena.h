@@ -0,0 +1,79 @@
+/*
+ * arena - a simple region allocator for the nuggets server
+ *
+ * An arena hands out memory from large blocks, and frees all of it at once.
+ * There is no way to free a single allocation. arena_reset makes all the
+ * memory available again but keeps the blocks, so an arena that is reset
+ * regularly (e.g. once per message) stops calling malloc once it has grown
+ * to the size it needs.
+ *
+ * An arena is not thread-safe; only one thread may use it at a time.
+ *
+ * Ribhu Hooja, March 2024
+ */
+
+#ifndef __ARENA_H
+#define __ARENA_H
+
+#include <stddef.h>
+
+/****************** global types *************************/
+typedef struct arena arena_t;
+
+/****************** functions ****************************/
+
+/****************** arena_new *****************************
+ *
+ * creates a new, empty arena
+ *
+ * Caller provides:
+ *  the size of the blocks to allocate, in bytes; allocations larger than
+ *  this get a block of their own
+ * We return:
+ *  A new, valid heap allocated arena_t*
+ *  NULL if error
+ * Caller is responsible for:
+ *  Later calling arena_delete on the returned pointer
+ */
+arena_t* arena_new(const size_t blockSize);
+
+/****************** arena_alloc ***************************
+ *
+ * allocates memory from an arena
+ *
+ * Caller provides:
+ *  valid pointer to an arena
+ *  the number of bytes wanted
+ * We return:
+ *  a pointer to that many zeroed bytes, aligned for any type
+ *  NULL if error
+ * Notes:
+ *  The memory stays valid until the next arena_reset or arena_delete;
+ *  it must NOT be passed to free or mem_free.
+ */
+void* arena_alloc(arena_t* arena, const size_t size);
+
+/****************** arena_reset ***************************
+ *
+ * frees everything allocated from an arena at once
+ *
+ * Caller provides:
+ *  valid pointer to an arena
+ * We do:
+ *  make all of the arena's memory available again, without giving any of
+ *  it back to the system
+ */
+void arena_reset(arena_t* arena);
+
+/****************** arena_delete **************************
+ *
+ * deletes an arena
+ *
+ * Caller provides:
+ *  valid pointer to an arena
+ * We do:
+ *  free the arena and everything allocated from it
+ */
+void arena_delete(arena_t* arena);
+
+#endif    // __ARENA_H
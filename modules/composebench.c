@@ -0,0 +1,151 @@
+/*
+ * a benchmark of the blend kernels behind grid_composeView
+ *
+ * For every map given on the command line, a player wanders about for a
+ * while, so that their display has cells in view, cells seen before and
+ * cells never seen. Then their display is composed over and over, with and
+ * without vector instructions. The two must give exactly the same display;
+ * if they ever differ the benchmark says where, and exits with status 1.
+ *
+ * usage: ./composebench map.txt...
+ *
+ * Ribhu Hooja, March 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "grid.h"
+
+/****************** file-local global constants **********/
+static const int numSteps = 300;          // moves the player makes first
+static const long cellsPerRun = 20000000; // cells composed for each timing
+
+/****************** local functions **********************/
+static double timeCompose(grid_t* grid, grid_t* visibleGrid, char* buffer,
+                                                              const int reps);
+static double now(void);
+
+/****************** main *********************************/
+int
+main(const int argc, char* argv[])
+{
+  if (argc < 2){
+    fprintf(stderr, "usage: %s map.txt...\n", argv[0]);
+    return 2;
+  }
+
+  bool hasSimd = grid_useSimd(true);
+  printf("vector kernel: %s\n\n", hasSimd ? "yes" : "not available");
+  printf("%-40s %8s %12s %12s %8s\n", "map", "cells", "plain ns", "vector ns",
+                                                                  "speedup");
+
+  int numMismatches = 0;
+  double totalPlain = 0;
+  double totalVector = 0;
+  for (int m = 1; m < argc; ++m){
+    FILE* fp = fopen(argv[m], "r");
+    if (fp == NULL){
+      fprintf(stderr, "could not open %s\n", argv[m]);
+      continue;
+    }
+    grid_t* grid = grid_fromMap(fp);
+    fclose(fp);
+    if (grid == NULL){
+      continue;
+    }
+
+    srand(42);
+    grid_nuggetsPopulate(grid, 10, 30, 250);
+    int px, py;
+    if (!grid_findRandomSpawnPosition(grid, &px, &py)){
+      grid_delete(grid);
+      continue;
+    }
+    grid_addPlayer(grid, px, py, 'A');
+
+    int length = grid_displayLength(grid);
+    char* plain = malloc(length + 1);
+    char* vector = malloc(length + 1);
+
+    // check the two kernels agree at every step of the walk
+    grid_t* visibleGrid = grid_generateVisibleGrid(grid, NULL, px, py);
+    for (int i = 0; i < numSteps; ++i){
+      int dx = rand() % 3 - 1;
+      int dy = rand() % 3 - 1;
+      if (grid_movePlayer(grid, px, py, dx, dy) >= 0){
+        px += dx;
+        py += dy;
+      }
+      grid_generateVisibleGrid(grid, visibleGrid, px, py);
+
+      grid_useSimd(false);
+      grid_composeView(grid, visibleGrid, plain);
+      grid_useSimd(true);
+      grid_composeView(grid, visibleGrid, vector);
+      if (memcmp(plain, vector, length + 1) != 0){
+        int at = 0;
+        while (plain[at] == vector[at]){
+          ++at;
+        }
+        printf("MISMATCH in %s at step %d, index %d: '%c' vs '%c'\n",
+                                      argv[m], i, at, plain[at], vector[at]);
+        ++numMismatches;
+        break;
+      }
+    }
+
+    int reps = cellsPerRun / length + 1;
+    grid_useSimd(false);
+    double plainTime = timeCompose(grid, visibleGrid, plain, reps);
+    grid_useSimd(true);
+    double vectorTime = timeCompose(grid, visibleGrid, vector, reps);
+    totalPlain += plainTime * reps;
+    totalVector += vectorTime * reps;
+
+    printf("%-40s %8d %12.0f %12.0f %7.2fx\n", argv[m], length,
+                          plainTime * 1e9, vectorTime * 1e9, plainTime / vectorTime);
+
+    free(plain);
+    free(vector);
+    grid_delete(visibleGrid);
+    grid_delete(grid);
+  }
+
+  printf("\noverall speedup: %.2fx\n", totalPlain / totalVector);
+  if (numMismatches > 0){
+    printf("FAIL: %d maps composed differently\n", numMismatches);
+    return 1;
+  }
+  return 0;
+}
+
+/****************** timeCompose ***************************
+ *
+ * returns the seconds one grid_composeView call takes, on average
+ * over reps calls
+ *
+ */
+static double
+timeCompose(grid_t* grid, grid_t* visibleGrid, char* buffer, const int reps)
+{
+  double start = now();
+  for (int i = 0; i < reps; ++i){
+    grid_composeView(grid, visibleGrid, buffer);
+  }
+  return (now() - start) / reps;
+}
+
+/****************** now ***********************************
+ *
+ * returns the current time in seconds
+ *
+ */
+static double
+now(void)
+{
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
@@ -0,0 +1,291 @@
+/*
+ * a file to test the DELTA encoding of displays
+ *
+ * Encodes a sequence of displays as DELTAs with delta_encode, as the game
+ * does for a client that sent MODE DELTA, and applies each one with
+ * delta_apply to a map that started blank, as the client does. After
+ * every frame that map must be the full display.
+ *
+ * The displays are what a player and the spectator see while players
+ * wander about a map, and some made up to check the exact lines sent:
+ * runs of changes joined across the unchanged cells between them, and a
+ * row sent whole because its runs would take longer. Real maps are too
+ * small for the second; it takes 3-digit rows and columns.
+ *
+ * Ribhu Hooja, March 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "grid.h"
+#include "delta.h"
+
+/****************** local types **************************/
+// one recipient's DELTAs, and what the test found in them
+typedef struct stream {
+  int rows;             // size of the map
+  int cols;
+  char* lastSent;       // the map the encoder thinks the recipient has
+  char* map;            // the recipient's map, made only from the DELTAs
+  char* before;         // lastSent before the latest DELTA
+  char* lines;          // the lines of the latest DELTA
+  int numFrames;        // frames sent
+  int numMismatches;    // frames after which map was not the display
+  int numJoined;        // lines that span unchanged cells
+} stream_t;
+
+/****************** local functions **********************/
+static stream_t* stream_new(const int rows, const int cols);
+static void stream_delete(stream_t* stream);
+static void sendFrame(stream_t* stream, const char* display);
+static int playMap(const char* mapFile, const int numMoves);
+static int checkMadeUp(void);
+
+/****************** main *********************************/
+int
+main()
+{
+  srand(42);
+
+  int numFailures = 0;
+  numFailures += playMap("../maps/main.txt", 2000);
+  numFailures += playMap("../maps/big.txt", 2000);
+  numFailures += checkMadeUp();
+
+  if (numFailures > 0){
+    printf("FAIL: %d checks failed\n", numFailures);
+    return 1;
+  }
+  printf("PASS: every DELTA rebuilt its display\n");
+  return 0;
+}
+
+/****************** playMap ******************************
+ *
+ * has players wander about a map, sending what player A sees and what
+ * the spectator sees after every move as DELTAs; returns the number of
+ * checks that failed
+ *
+ */
+static int
+playMap(const char* mapFile, const int numMoves)
+{
+  FILE* fp = fopen(mapFile, "r");
+  if (fp == NULL){
+    printf("could not open %s\n", mapFile);
+    return 1;
+  }
+  grid_t* grid = grid_fromMap(fp);
+  fclose(fp);
+  grid_nuggetsPopulate(grid, 10, 30, 250);
+
+  static const int numPlayers = 4;
+  int px[numPlayers];
+  int py[numPlayers];
+  for (int i = 0; i < numPlayers; ++i){
+    grid_findRandomSpawnPosition(grid, &px[i], &py[i]);
+    grid_addPlayer(grid, px[i], py[i], 'A' + i);
+  }
+
+  int rows = grid_numrows(grid);
+  int cols = grid_numcols(grid);
+  stream_t* player = stream_new(rows, cols);
+  stream_t* spectator = stream_new(rows, cols);
+  char* display = malloc(grid_displayLength(grid) + 1);
+  grid_t* visibleGrid = NULL;
+
+  for (int i = 0; i <= numMoves; ++i){
+    // the first frames go out before anyone moves
+    if (i > 0){
+      int who = rand() % numPlayers;
+      int dx = rand() % 3 - 1;
+      int dy = rand() % 3 - 1;
+      if (grid_movePlayer(grid, px[who], py[who], dx, dy) >= 0){
+        px[who] += dx;
+        py[who] += dy;
+      }
+    }
+
+    visibleGrid = grid_generateVisibleGrid(grid, visibleGrid, px[0], py[0]);
+    sendFrame(player, grid_composeView(grid, visibleGrid, display));
+    sendFrame(spectator, grid_displayView(grid));
+  }
+
+  printf("%s: player: %d frames, %d joined runs, %d mismatches; "
+         "spectator: %d frames, %d joined runs, %d mismatches\n",
+         mapFile, player->numFrames, player->numJoined, player->numMismatches,
+         spectator->numFrames, spectator->numJoined, spectator->numMismatches);
+  int numFailures = player->numMismatches + spectator->numMismatches;
+  if (player->numJoined + spectator->numJoined == 0){
+    printf("%s: no run was ever joined\n", mapFile);
+    ++numFailures;
+  }
+
+  stream_delete(player);
+  stream_delete(spectator);
+  grid_delete(visibleGrid);
+  grid_delete(grid);
+  free(display);
+  return numFailures;
+}
+
+/****************** checkMadeUp **************************
+ *
+ * sends made-up displays whose DELTAs are known exactly; returns the
+ * number of checks that failed
+ *
+ */
+static int
+checkMadeUp(void)
+{
+  const int rows = 150;
+  const int cols = 300;
+  stream_t* stream = stream_new(rows, cols);
+  int numFailures = 0;
+
+  // a room, then a copy of it to change
+  char* room = malloc(rows * (cols + 1) + 1);
+  delta_blank(room, rows, cols);
+  for (int y = 0; y < rows; ++y){
+    memset(room + y * (cols + 1), '.', cols);
+  }
+  char* changed = malloc(rows * (cols + 1) + 1);
+  strcpy(changed, room);
+
+  // from a blank map, every row changes end to end
+  sendFrame(stream, room);
+  int numLines = 0;
+  for (const char* c = stream->lines; *c != '\0'; ++c){
+    numLines += *c == '\n';
+  }
+  if (numLines != rows || strncmp(stream->lines, "0 0 ...", 7) != 0){
+    printf("made up: the first frame was not sent row by row\n");
+    ++numFailures;
+  }
+
+  // row 3: two changes 3 cells apart are joined into one run;
+  // row 4: two changes 19 cells apart are not;
+  // row 140: a change every 9 cells is 34 runs, which take 326
+  // characters, but the whole row takes 307, so it is sent whole
+  char* row3 = changed + 3 * (cols + 1);
+  char* row4 = changed + 4 * (cols + 1);
+  char* row140 = changed + 140 * (cols + 1);
+  row3[10] = row3[14] = '*';
+  row4[10] = row4[30] = '*';
+  for (int x = 0; x < cols; x += 9){
+    row140[x] = '*';
+  }
+  char* expected = malloc(cols + 100);
+  int length = sprintf(expected, "3 10 *...*\n4 10 *\n4 30 *\n140 0 ");
+  memcpy(expected + length, row140, cols);
+  strcpy(expected + length + cols, "\n");
+
+  sendFrame(stream, changed);
+  if (strcmp(stream->lines, expected) != 0){
+    printf("made up: expected the DELTA\n%sbut it was\n%s", expected, stream->lines);
+    ++numFailures;
+  }
+
+  // nothing changed, so nothing is sent
+  sendFrame(stream, changed);
+  if (stream->lines[0] != '\0'){
+    printf("made up: an unchanged frame sent\n%s", stream->lines);
+    ++numFailures;
+  }
+
+  // and back again
+  sendFrame(stream, room);
+
+  printf("made up: %d frames, %d joined runs, %d mismatches\n",
+         stream->numFrames, stream->numJoined, stream->numMismatches);
+  numFailures += stream->numMismatches;
+
+  stream_delete(stream);
+  free(room);
+  free(changed);
+  free(expected);
+  return numFailures;
+}
+
+/****************** sendFrame ****************************
+ *
+ * encodes the display as a DELTA from the last one, applies it to the
+ * recipient's map, and checks that the map is now the display
+ *
+ */
+static void
+sendFrame(stream_t* stream, const char* display)
+{
+  int rows = stream->rows;
+  int cols = stream->cols;
+  int length = rows * (cols + 1);
+
+  memcpy(stream->before, stream->lastSent, length);
+  delta_encode(display, stream->lastSent, rows, cols, stream->lines);
+  ++stream->numFrames;
+
+  if (!delta_apply(stream->map, rows, cols, stream->lines)
+      || strcmp(stream->map, display) != 0
+      || strcmp(stream->lastSent, display) != 0){
+    ++stream->numMismatches;
+    return;
+  }
+
+  // a line with a cell that did not change joins the runs either side
+  const char* line = stream->lines;
+  while (*line != '\0'){
+    int row, col, start;
+    sscanf(line, "%d %d %n", &row, &col, &start);
+    const char* text = line + start;
+    int textLength = strchr(text, '\n') - text;
+    int cell = row * (cols + 1) + col;
+    for (int i = 0; i < textLength; ++i){
+      if (stream->before[cell + i] == display[cell + i]){
+        ++stream->numJoined;
+        break;
+      }
+    }
+    line = text + textLength + 1;
+  }
+}
+
+/****************** stream_new ***************************
+ *
+ * makes a recipient who has been sent nothing yet
+ *
+ */
+static stream_t*
+stream_new(const int rows, const int cols)
+{
+  int length = rows * (cols + 1);
+  stream_t* stream = malloc(sizeof(stream_t));
+  stream->rows = rows;
+  stream->cols = cols;
+  stream->lastSent = malloc(length + 1);
+  stream->map = malloc(length + 1);
+  stream->before = malloc(length + 1);
+  stream->lines = malloc(3 * length + 64);   // as the game allows
+  delta_blank(stream->lastSent, rows, cols);
+  delta_blank(stream->map, rows, cols);
+  stream->numFrames = 0;
+  stream->numMismatches = 0;
+  stream->numJoined = 0;
+  return stream;
+}
+
+/****************** stream_delete ************************
+ *
+ * frees everything in a stream
+ *
+ */
+static void
+stream_delete(stream_t* stream)
+{
+  free(stream->lastSent);
+  free(stream->map);
+  free(stream->before);
+  free(stream->lines);
+  free(stream);
+}
@@ -10,12 +10,18 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 #include "log.h"
+#include "delta.h"
 #include "mem.h"
 #include "spectator.h"
 #include "player.h"
 #include "grid.h" 
 #include "game.h"
+#include "jobs.h"
+#include "arena.h"
 #include "mapchars.h"
 
 // Global Constants
@@ -24,37 +30,93 @@ static const int MaxPlayers = 26;           // maximum number of players
 static const int GoldTotal = 250;           // amount of gold in the game
 static const int GoldMinNumPiles = 10;      // minimum number of gold piles
 static const int GoldMaxNumPiles = 30;      // maximum number of gold piles
+static const size_t ArenaBlockSize = 16384; // block size of the per-game arena
+static const size_t ScratchBlockSize = 4096;// block size of the per-message arena
+
+/****************** the frame type ***********************/
+// one recipient's part in a broadcast; see updateAndDisplayAll
+typedef struct frame{
+    grid_t* grid;               // what this recipient sees; NULL if nothing to send
+    unsigned long hash;         // hash of that grid's display
+    int owner;                  // first recipient with this same frame
+    bool suppressed;            // whether an unchanged frame was held back
+    bool reindex;               // whether the player's view was recalculated in full
+} frame_t;
 
 /****************** the game type ************************/
 typedef struct game{
-    player_t** players;         // array of players
+    playertable_t* players;     // the players, one array per field
     grid_t* masterGrid;         // the master grid(map) which covers the whole map
     spectator_t* spectator;     // the address of the spectator
-    int numPlayer;              // number of players joined the game so far
     int goldRemain;             // the remaining gold in the game
+    arena_t* arena;             // memory that lives as long as the game
+    arena_t* scratch;           // memory that lives while handling one message
+    jobs_t* jobs;               // worker pool for the per-player work after each move
+    frame_t* frames;            // per-recipient broadcast state: players, then the spectator
+    int* distinct;              // owners of the distinct frames in this broadcast
+    int numDistinct;            // number of distinct frames in this broadcast
+    grid_t* snapshot;           // the master grid snapshot being broadcast
+    char** buffers;             // one display buffer per worker, for composing frames
+    unsigned long* sentHash;    // hash of the display last sent to each player
+    unsigned long spectatorVersion;  // snapshot version the spectator last saw
+    unsigned long numSuppressed;     // frames not sent because nothing changed
+
+    // interest management: who can see into each tile of the map
+    unsigned long* subscribers; // per tile, a bit for each player who can see into it
+    int numTiles;               // number of tiles in the map
+    int* indexedX;              // where each player was when subscribed; -1 if never
+    int* indexedY;
+    unsigned long broadcastVersion;  // snapshot version of the last broadcast
+    const int* changedCells;    // cells changed since then, for this broadcast
+    int numChangedCells;
+    bool allChanged;            // whether to treat every cell as changed
+    unsigned long interested;   // players subscribed to a changed cell's tile
+
+    // recipients who asked for MODE DELTA, by slot: players by index, then
+    // the spectator in slot MaxPlayers
+    bool* wantsDelta;           // whether each slot is sent DELTAs
+    char** lastSent;            // the display each slot was last sent, once it asks
+    unsigned int* frameNumber;  // number of the last DELTA sent to each slot
+    char** deltas;              // one buffer per worker, for encoding DELTAs
+
+    // the KEY being handled, if it came with a sequence number to echo
+    int traceSlot;              // the player who sent it; -1 if none
+    unsigned long traceSeq;     // its sequence number
+    long long traceReceived;    // when it came, in microseconds
 } game_t;
 
 /****************** local functions **********************/
-static void sendGoldMessage(game_t* game, player_t* player, const int goldCollected, const int purse, const int goldRemaining);
-static void sendAllGoldMessages(game_t* game, player_t* goldJustCollectedPlayer, int goldJustCollected);
-static void displayAllPlayers(game_t* game);
-static void updateAllVisibleGrids(game_t* game);
+static void sendGoldMessage(const addr_t address, const int goldCollected, const int purse, const int goldRemaining);
+static void sendAllGoldMessages(game_t* game, const int collector, int goldJustCollected);
+static void updateAndDisplayAll(game_t* game);
+static void findInterestedPlayers(game_t* game);
+static void resubscribe(game_t* game, const int index);
+static void updateAndHashTask(void* arg, const int index, const int worker);
+static void sendTask(void* arg, const int index, const int worker);
 static char* get_result(game_t* game);
-static player_t* findPlayerByCoords(game_t* game, const int x, const int y);
+static void movePlayer(game_t* game, const int id, const int dx, const int dy, const bool swap);
+static void sendFrame(game_t* game, const int slot, const addr_t address,
+                      const char* display, const int worker);
+static int traceSuffix(game_t* game, char* buf, const size_t size);
+static long long microsNow(void);
 
 
 
 // this function initializes the whole game by initializing 
 // each small part of it.
-game_t* game_init(FILE* mapfile){
+game_t* game_init(FILE* mapfile, const int sightRadius){
 
     game_t* game = mem_malloc_assert(sizeof(game_t), "Failed to allocate memory for game.\n");
+
+    // everything else the game needs comes from its arenas
+    game->arena = arena_new(ArenaBlockSize);
+    game->scratch = arena_new(ScratchBlockSize);
     
     // initialize grid
     game->masterGrid = grid_fromMap(mapfile);
+    grid_setSightRadius(game->masterGrid, sightRadius);
     
     // which is between max and min number of piles give as global variable.
-    game->numPlayer = 0;// set num of player to zero
     game->goldRemain = GoldTotal;// set the gold remaining in the game to GoldTotal.
 
 
@@ -64,11 +126,63 @@ game_t* game_init(FILE* mapfile){
     }
     
 
-    // initialize player 
-    game->players = mem_calloc_assert(MaxPlayers, sizeof(player_t*), "Failed to allocate memory for Player.\n"); 
+    // initialize player table
+    game->players = mem_assert(playertable_new(MaxPlayers, game->arena), "Failed to allocate memory for Player.\n"); 
 
     // initialize spectator
     game->spectator = NULL;
+
+    // one worker per online processor; with a single processor everything
+    // simply runs inline on the calling thread
+    game->jobs = jobs_new(sysconf(_SC_NPROCESSORS_ONLN));
+
+    // broadcast bookkeeping, one slot per player plus one for the spectator
+    game->frames = mem_assert(arena_alloc(game->arena, (MaxPlayers + 1) * sizeof(frame_t)), "Failed to allocate memory for frames.\n");
+    game->distinct = mem_assert(arena_alloc(game->arena, (MaxPlayers + 1) * sizeof(int)), "Failed to allocate memory for frames.\n");
+    game->numDistinct = 0;
+    game->snapshot = NULL;
+    game->sentHash = mem_assert(arena_alloc(game->arena, MaxPlayers * sizeof(unsigned long)), "Failed to allocate memory for frames.\n");
+
+    // players' displays are composed from their visible cells as they are sent
+    int numWorkers = jobs_numWorkers(game->jobs);
+    int displaySize = grid_displayLength(game->masterGrid) + 1;
+    game->buffers = mem_assert(arena_alloc(game->arena, numWorkers * sizeof(char*)), "Failed to allocate memory for frames.\n");
+    for (int w = 0; w < numWorkers; w++){
+        game->buffers[w] = mem_assert(arena_alloc(game->arena, displaySize), "Failed to allocate memory for frames.\n");
+    }
+
+    // nobody gets DELTAs until they ask; a DELTA is at most about twice
+    // the size of the display (see delta_encode)
+    game->wantsDelta = mem_assert(arena_alloc(game->arena, (MaxPlayers + 1) * sizeof(bool)), "Failed to allocate memory for frames.\n");
+    game->lastSent = mem_assert(arena_alloc(game->arena, (MaxPlayers + 1) * sizeof(char*)), "Failed to allocate memory for frames.\n");
+    game->frameNumber = mem_assert(arena_alloc(game->arena, (MaxPlayers + 1) * sizeof(unsigned int)), "Failed to allocate memory for frames.\n");
+    for (int i = 0; i <= MaxPlayers; i++){
+        game->wantsDelta[i] = false;
+        game->lastSent[i] = NULL;
+        game->frameNumber[i] = 0;
+    }
+    game->deltas = mem_assert(arena_alloc(game->arena, numWorkers * sizeof(char*)), "Failed to allocate memory for frames.\n");
+    for (int w = 0; w < numWorkers; w++){
+        game->deltas[w] = mem_assert(arena_alloc(game->arena, 3 * displaySize + 64), "Failed to allocate memory for frames.\n");
+    }
+    game->spectatorVersion = 0;
+    game->numSuppressed = 0;
+    game->traceSlot = -1;
+
+    // nobody is subscribed to anything until their first display
+    game->numTiles = grid_numTiles(game->masterGrid);
+    game->subscribers = mem_assert(arena_alloc(game->arena, game->numTiles * sizeof(unsigned long)), "Failed to allocate memory for subscribers.\n");
+    game->indexedX = mem_assert(arena_alloc(game->arena, MaxPlayers * sizeof(int)), "Failed to allocate memory for subscribers.\n");
+    game->indexedY = mem_assert(arena_alloc(game->arena, MaxPlayers * sizeof(int)), "Failed to allocate memory for subscribers.\n");
+    for (int i = 0; i < MaxPlayers; i++){
+        game->indexedX[i] = -1;
+        game->indexedY[i] = -1;
+    }
+    game->broadcastVersion = 0;
+    game->changedCells = NULL;
+    game->numChangedCells = 0;
+    game->allChanged = true;
+    game->interested = 0;
     return game;
 }
 
@@ -77,20 +191,15 @@ game_t* game_init(FILE* mapfile){
 // Check game.h for more information.
 void game_addPlayer(game_t* game, player_t* player){
     if (game != NULL && player != NULL){
-        if (game->numPlayer < MaxPlayers){
-            game->players[game->numPlayer] = player;
-            game->numPlayer++;
-
-            char letter = player_getLetter(player);
-
-            grid_addPlayer(game->masterGrid, player_getX(player), player_getY(player), letter);
-            updateAllVisibleGrids(game);
-            displayAllPlayers(game);
-            
-        }
-        else{
-            player_sendMessage(player, "QUIT Game is full: no more players can join.\n");
+        playertable_t* players = game->players;
+        int id = player_getId(player);
+        if (playertable_get(players, id) != player){
+            flog_v(stderr, "Cannot add a player from another game's table.\n");
+            return;
         }
+
+        grid_addPlayer(game->masterGrid, players->x[id], players->y[id], players->letter[id]);
+        updateAndDisplayAll(game);
     }
 }
 
@@ -98,18 +207,18 @@ void game_addPlayer(game_t* game, player_t* player){
 // Check game.h for more information.
 void game_removePlayer(game_t* game, player_t* playerA){
     if (game != NULL && playerA != NULL){
-        player_t* playerB = game_findPlayer(game,player_getAddress(playerA)); 
-        if(playerB == NULL){
+        playertable_t* players = game->players;
+        int id = player_getId(playerA);
+        if (playertable_get(players, id) != playerA){
             flog_v(stderr, "Cannot remove a player that is not in players array.\n");
             return;
         }
         player_sendMessage(playerA,"QUIT Thanks for playing!\n");
-        player_setInactive(playerA);
+        players->isActive[id] = false;
 
-        grid_removePlayer(game->masterGrid, player_getLetter(playerA), player_getX(playerA), player_getY(playerA));
+        grid_removePlayer(game->masterGrid, players->letter[id], players->x[id], players->y[id]);
 
-        updateAllVisibleGrids(game);
-        displayAllPlayers(game);
+        updateAndDisplayAll(game);
         
     }
 }
@@ -123,6 +232,8 @@ void game_addSpectator(game_t* game, addr_t address){
             spectator_delete(game->spectator);
         }
         game-> spectator = spectator_new(address);
+        game->spectatorVersion = 0;     // has not seen anything yet
+        game->wantsDelta[MaxPlayers] = false;
     }
 }
 
@@ -157,6 +268,148 @@ game_masterGrid(game_t* game)
   return game->masterGrid;
 }
 
+/****************** game_arena ****************************
+ *
+ * see game.h for description and usage
+ *
+ */
+arena_t*
+game_arena(game_t* game)
+{
+  if (game == NULL){
+    return NULL;
+  }
+
+  return game->arena;
+}
+
+/****************** game_scratch **************************
+ *
+ * see game.h for description and usage
+ *
+ */
+arena_t*
+game_scratch(game_t* game)
+{
+  if (game == NULL){
+    return NULL;
+  }
+
+  return game->scratch;
+}
+
+/****************** game_resetScratch *********************
+ *
+ * see game.h for description and usage
+ *
+ */
+void
+game_resetScratch(game_t* game)
+{
+  if (game == NULL){
+    return;
+  }
+
+  arena_reset(game->scratch);
+}
+
+/****************** game_setDeltaMode *********************
+ *
+ * see game.h for usage and description
+ *
+ */
+bool
+game_setDeltaMode(game_t* game, addr_t address)
+{
+  if (game == NULL){
+    return false;
+  }
+
+  // which slot is asking
+  int slot;
+  player_t* player = game_findPlayer(game, address);
+  if (player != NULL){
+    slot = player_getId(player);
+  } else if (game->spectator != NULL
+             && message_eqAddr(spectator_getAddress(game->spectator), address)){
+    slot = MaxPlayers;
+  } else {
+    return false;
+  }
+
+  // start again from a blank screen, as the client does
+  int numrows = grid_numrows(game->masterGrid);
+  int numcols = grid_numcols(game->masterGrid);
+  int length = grid_displayLength(game->masterGrid);
+  if (game->lastSent[slot] == NULL){
+    game->lastSent[slot] = mem_assert(arena_alloc(game->arena, length + 1), "Failed to allocate memory for frames.\n");
+  }
+  memset(game->lastSent[slot], mapchars_solidRock, length);
+  for (int y = 0; y < numrows; y++){
+    game->lastSent[slot][y * (numcols + 1) + numcols] = '\n';
+  }
+  game->lastSent[slot][length] = '\0';
+  game->wantsDelta[slot] = true;
+  game->frameNumber[slot] = 0;
+
+  // and send them everything they can see now
+  if (slot == MaxPlayers){
+    game->spectatorVersion = 0;
+  } else {
+    game->players->viewChanged[slot] = true;
+    game->sentHash[slot] = 0;
+  }
+  updateAndDisplayAll(game);
+  return true;
+}
+
+/****************** game_traceKey *************************
+ *
+ * see game.h for usage and description
+ *
+ */
+void
+game_traceKey(game_t* game, addr_t address, const unsigned long seq)
+{
+  if (game == NULL){
+    return;
+  }
+
+  long long received = microsNow();
+  player_t* player = game_findPlayer(game, address);
+  game->traceSlot = player == NULL ? -1 : player_getId(player);
+  game->traceSeq = seq;
+  game->traceReceived = received;
+}
+
+/****************** game_endTrace *************************
+ *
+ * see game.h for usage and description
+ *
+ */
+void
+game_endTrace(game_t* game)
+{
+  if (game != NULL){
+    game->traceSlot = -1;
+  }
+}
+
+/****************** game_numSuppressedFrames **************
+ *
+ * see game.h for description and usage
+ *
+ */
+unsigned long
+game_numSuppressedFrames(game_t* game)
+{
+  if (game == NULL){
+    return 0;
+  }
+
+  return game->numSuppressed;
+}
+
 /****************** game_numPlayers ***********************
  *
  * see game.h for description and usage
@@ -169,13 +422,14 @@ game_numPlayers(game_t* game)
     return 0;
   }
 
-  return game->numPlayer;
+  return game->players->count;
 }
 
-// to get the players array. Check game.h for more information.
-player_t** game_getPlayers(game_t* game){
+// to get the player table. Check game.h for more information.
+playertable_t* game_getPlayers(game_t* game){
     if (game == NULL){
         flog_v(stderr, "Cannot get the players array of null game.\n");
+        return NULL;
     }
     return game->players;
 }
@@ -206,16 +460,12 @@ player_t* game_findPlayer(game_t* game, addr_t address){
         return NULL;
     }
     else{
-        player_t* player;
-        for (int i = 0; i < game->numPlayer; i++){
-            player = game->players[i];
-            if (message_eqAddr(player_getAddress(player), address)){
-                return player;
-            }
+        int id = playertable_findAddress(game->players, address);
+        if (id < 0){
+            flog_v(stderr, "There is no pplayers in array with the given address.\n");
+            return NULL;
         }
-        // after we come out of loop and could not find the player in players array
-        flog_v(stderr, "There is no pplayers in array with the given address.\n");
-        return NULL;
+        return playertable_get(game->players, id);
     }
 }
 
@@ -232,48 +482,34 @@ bool game_move(game_t* game, addr_t address, int dx, int dy){
         flog_v(stderr, "Cannot move player. Either Null player or Null game c.\n");
         return false;
     }
-    player_t* player = game_findPlayer(game, address);
+    playertable_t* players = game->players;
+    int id = playertable_findAddress(players, address);
 
-    if (player == NULL || !player_isActive(player)){
+    if (id < 0 || !players->isActive[id]){
         flog_v(stderr, "Player not in  game\n");
         return false;
     }
     
     // to get the current x and y position of the player
-    int px = player_getX(player);
-    int py = player_getY(player);
-    int returnVal = grid_movePlayer(game->masterGrid, px, py, dx, dy);
+    int returnVal = grid_movePlayer(game->masterGrid, players->x[id], players->y[id], dx, dy);
 
     
     if (returnVal == -1){   // no move
       return false;
-    } else if (returnVal == -2) {   // player there; swap!
-      grid_swapPlayers(game->masterGrid, px, py, px + dx, py + dy);
-      player_t* other = findPlayerByCoords(game, px + dx, py + dy);
-      if (other != NULL){
-        player_setX(other, px);
-        player_setY(other, py);
-      }
-      player_moveDiagonal(player, dx, dy);
-    } else {
-      player_moveDiagonal(player, dx, dy);
     }
+    movePlayer(game, id, dx, dy, returnVal == -2);
 
     // to update the gold claimed by the player to new coordinates if the player steped on a gold pile.
     if (returnVal > 0){
         int claimedGold = returnVal;
-        player_addGold(player, claimedGold);
+        players->gold[id] += claimedGold;
 
-        //int purse = player_getGold(player); // the amount of gold player has in its purse.
         game->goldRemain -= claimedGold;
-        // int remain = game->goldRemain;      // the amount of gold remaining in the game.
-        sendAllGoldMessages(game, player, claimedGold);
+        sendAllGoldMessages(game, id, claimedGold);
     }
 
-    // update the visible grids for each player
-
-    updateAllVisibleGrids(game);
-    displayAllPlayers(game);
+    // update the visible grids for each player, and display them
+    updateAndDisplayAll(game);
     
     if (game->goldRemain == 0){
        game_over(game);
@@ -295,46 +531,34 @@ bool game_longMove(game_t* game,addr_t address, int dx ,int dy){
         return false;
     }
 
-    player_t* player = game_findPlayer(game, address);
+    playertable_t* players = game->players;
+    int id = playertable_findAddress(players, address);
 
-    if (player == NULL || !player_isActive(player)){
+    if (id < 0 || !players->isActive[id]){
         flog_v(stderr, "Player not in  game\n");
         return false;
     }
+    player_t* player = playertable_get(players, id);
 
     int returnVal; // return value from move; is -1 if move failed
     int goldCollected = 0;
-    while ((returnVal = grid_movePlayer(game->masterGrid, player_getX(player), player_getY(player), dx, dy)) != -1) {
-        if (returnVal == -2){
-            int px = player_getX(player);
-            int py = player_getY(player);
-
-            grid_swapPlayers(game->masterGrid, px, py, px + dx, py + dy);
-            player_t* other = findPlayerByCoords(game, px + dx, py + dy);
-
-            if (other != NULL){
-                player_setX(other, px);
-                player_setY(other, py);
-            }
-        }
-
-        player_moveDiagonal(player, dx, dy);
+    while ((returnVal = grid_movePlayer(game->masterGrid, players->x[id], players->y[id], dx, dy)) != -1) {
+        movePlayer(game, id, dx, dy, returnVal == -2);
         goldCollected += returnVal;
 
         player_updateVisibleGrid(player, game->masterGrid);
     }
 
     if (goldCollected > 0){
-        player_addGold(player, goldCollected);
+        players->gold[id] += goldCollected;
         game->goldRemain -= goldCollected;
-        sendAllGoldMessages(game, player, goldCollected);
+        sendAllGoldMessages(game, id, goldCollected);
     }
 
 
 
-    // update the visible grids for each player
-    updateAllVisibleGrids(game);
-    displayAllPlayers(game);
+    // update the visible grids for each player, and display them
+    updateAndDisplayAll(game);
 
     if (game->goldRemain == 0){
        game_over(game);
@@ -345,28 +569,27 @@ bool game_longMove(game_t* game,addr_t address, int dx ,int dy){
 }
 
 // this is to send the amount of gold the player got, the remaing gold in the game, in thier purse
-static void sendAllGoldMessages(game_t* game, player_t* goldJustCollectedPlayer, int goldJustCollected){
+static void sendAllGoldMessages(game_t* game, const int collector, int goldJustCollected){
 
-    if (game == NULL || goldJustCollectedPlayer == NULL){
+    if (game == NULL || collector < 0){
         return;
     }
 
     int remain = game->goldRemain;
-    addr_t address = player_getAddress(goldJustCollectedPlayer);
-    for (int i = 0; i < game->numPlayer; ++i){
-        player_t* player = game->players[i];
-        if (player_isActive(player)){
-
-            int goldCollected = 0;
-            int purse = player_getGold(player);
-
-            if (message_eqAddr(address, player_getAddress(player))){
-              goldCollected = goldJustCollected;
-
+    playertable_t* players = game->players;
+    for (int i = 0; i < players->count; ++i){
+        if (players->isActive[i]){
+            int goldCollected = i == collector ? goldJustCollected : 0;
+            if (i == game->traceSlot){
+                char message[100];
+                int length = snprintf(message, sizeof(message), "GOLD %d %d %d",
+                                      goldCollected, players->gold[i], remain);
+                traceSuffix(game, message + length, sizeof(message) - length);
+                message_send(players->address[i], message);
+            } else {
+                sendGoldMessage(players->address[i], goldCollected, players->gold[i],
+                                                                    remain);
             }
-
-            sendGoldMessage(game, player, goldCollected, purse,
-                                                         remain);
         }
     }
 
@@ -381,74 +604,317 @@ static void sendAllGoldMessages(game_t* game, player_t* goldJustCollectedPlayer,
 
 /****************** sendGoldMessage ***********************
  *
- * sends a "GOLD n p r" message to the player
+ * sends a "GOLD n p r" message to the player at the address
  *
  */
-static void sendGoldMessage(game_t* game, player_t* player, const int goldCollected, 
-                                                            const int purse,
-                                                            const int remaining)
+static void sendGoldMessage(const addr_t address, const int goldCollected, 
+                                                  const int purse,
+                                                  const int remaining)
 {
   char message[100];
   snprintf(message, sizeof(message), "GOLD %d %d %d", goldCollected, purse, remaining);
-  player_sendMessage(player, message);
+  message_send(address, message);
 }
 
 
 
-// to update the visible grid of each player 
-static void updateAllVisibleGrids(game_t* game){
-  if (game == NULL){
-    return;
+// to update the visible grid of each player and send everyone their display.
+// This runs in three steps:
+//  1. (parallel) each player's visible grid is updated from a snapshot of the
+//     master grid, and every recipient whose view may have changed has its
+//     frame hashed; recipients whose frame is what they were last sent get
+//     nothing.
+//     Only players who moved, or everyone if something changed what blocks
+//     vision, have their view recalculated in full; the others
+//     just refresh the changed cells, and only if they can see into a tile
+//     with a changed cell in it
+//  2. (serial) players whose view was recalculated are resubscribed to the tiles they can now
+//     see, and recipients whose frames are byte-identical are grouped, so
+//     each distinct frame has one owner
+//  3. (parallel) each distinct frame is composed from the snapshot and the
+//     owner's visible cells, and sent to every recipient in its group
+// jobs_run is a barrier, so everything is sent before the next input is applied.
+static void updateAndDisplayAll(game_t* game){
+    if (game == NULL){
+        return;
+    }
+
+    mem_phasePush("broadcast");
+
+    // every task in this broadcast reads the same snapshot
+    grid_publish(game->masterGrid);
+    int reader;
+    game->snapshot = grid_snapshotAcquire(game->masterGrid, &reader);
+    findInterestedPlayers(game);
+
+    int numRecipients = game->players->count + 1;
+    jobs_run(game->jobs, numRecipients, updateAndHashTask, game);
+
+    game->numDistinct = 0;
+    for (int i = 0; i < numRecipients; ++i){
+        frame_t* frame = &game->frames[i];
+        if (frame->reindex){
+            resubscribe(game, i);
+        }
+        if (frame->suppressed){
+            game->numSuppressed++;
+        }
+        if (frame->grid == NULL){
+            continue;
+        }
+
+        frame->owner = i;
+        for (int d = 0; d < game->numDistinct; ++d){
+            frame_t* other = &game->frames[game->distinct[d]];
+            if (other->hash == frame->hash && grid_viewEquals(game->snapshot, other->grid, frame->grid)){
+                frame->owner = game->distinct[d];
+                break;
+            }
+        }
+        if (frame->owner == i){
+            game->distinct[game->numDistinct++] = i;
+        }
+    }
+
+    jobs_run(game->jobs, game->numDistinct, sendTask, game);
+
+    grid_snapshotRelease(game->masterGrid, reader);
+    game->snapshot = NULL;
+    game->changedCells = NULL;
+
+    mem_phasePop();
+}
+
+/****************** findInterestedPlayers *****************
+ *
+ * works out which cells changed since the last broadcast, and
+ * which players are subscribed to a tile holding one of them
+ *
+ */
+static void
+findInterestedPlayers(game_t* game)
+{
+  unsigned long version = grid_snapshotVersion(game->snapshot);
+
+  game->changedCells = NULL;
+  game->numChangedCells = 0;
+  game->allChanged = false;
+  game->interested = 0;
+
+  if (version == game->broadcastVersion){
+    return;     // nothing has changed
   }
 
-  for (int i = 0; i < game->numPlayer; ++i){
-      player_t* curr = game->players[i];
-      if (!player_isActive(curr)){
-          continue;
-      }
-      player_updateVisibleGrid(curr, game->masterGrid);
+  // the list only covers the step from the previous snapshot
+  if (version == game->broadcastVersion + 1){
+    game->changedCells = grid_changedCells(game->snapshot, &game->numChangedCells);
   }
+  game->broadcastVersion = version;
 
+  if (game->changedCells == NULL){
+    game->allChanged = true;
+    return;
+  }
+
+  for (int i = 0; i < game->numChangedCells; ++i){
+    int tile = grid_tileOfCell(game->masterGrid, game->changedCells[i]);
+    if (tile >= 0){
+      game->interested |= game->subscribers[tile];
+    }
+  }
 }
 
-static void displayAllPlayers(game_t* game){
-    if (game == NULL){
-        return;
+/****************** resubscribe ***************************
+ *
+ * subscribes a player to exactly the tiles that their newly
+ * calculated visible grid can see into
+ *
+ */
+static void
+resubscribe(game_t* game, const int index)
+{
+  playertable_t* players = game->players;
+  grid_t* visibleGrid = players->visibleGrid[index];
+  unsigned long bit = 1UL << index;
+
+  for (int tile = 0; tile < game->numTiles; ++tile){
+    if (grid_seesTile(visibleGrid, tile)){
+      game->subscribers[tile] |= bit;
+    } else {
+      game->subscribers[tile] &= ~bit;
     }
+  }
 
-    player_t** players = game->players;
-    char* display = "DISPLAY\n";
-    int displayLen = strlen(display);
-    for (int i = 0; i < game->numPlayer; ++i){
-        player_t* player = players[i];
-        if (!player_isActive(player)){
-            continue;
-        }
-        
-        char* gridString = grid_getDisplay(player_getVisibleGrid(player));
-        int gridLen = strlen(gridString);
-        int length = displayLen + gridLen;
+  game->indexedX[index] = players->x[index];
+  game->indexedY[index] = players->y[index];
+}
 
-        char* message = mem_calloc_assert(length + 1, sizeof(char), "Could not allocate memory for display grid of each player.\n");
-        snprintf(message, length, "DISPLAY\n%s", gridString);
-        player_sendMessage(player, message);
+/****************** updateAndHashTask *********************
+ *
+ * step 1 for one recipient: task i < the number of players is player i,
+ * and the last task is the spectator. Recipients that should
+ * not get a display are left with a NULL frame grid.
+ *
+ * runs on a worker thread, so it must not touch the mem_ counters
+ *
+ */
+static void
+updateAndHashTask(void* arg, const int index, const int worker)
+{
+  game_t* game = arg;
+  playertable_t* players = game->players;
+  frame_t* frame = &game->frames[index];
+  frame->grid = NULL;
+  frame->suppressed = false;
+  frame->reindex = false;
+
+  if (index == players->count){
+    if (game->spectator != NULL){
+      // the spectator sees the whole master grid, so it has changed
+      // exactly when a new snapshot has been published
+      unsigned long version = grid_snapshotVersion(game->snapshot);
+      if (version != game->spectatorVersion){
+        frame->grid = game->snapshot;
+        game->spectatorVersion = version;
+      } else {
+        frame->suppressed = true;
+      }
+    }
+  } else {
+    if (players->isActive[index]){
+      player_t* player = playertable_get(players, index);
+
+      // unless something changed what blocks vision, what a player can see
+      // depends only on where they are, so unless they have moved only the
+      // changed cells they can see need updating. Otherwise they may see
+      // other tiles than before, even standing still, so are resubscribed
+      bool moved = players->x[index] != game->indexedX[index]
+                || players->y[index] != game->indexedY[index];
+      if (moved || game->allChanged){
+        player_updateVisibleGrid(player, game->snapshot);
+        frame->reindex = true;
+      } else if (game->interested & (1UL << index)){
+        player_refreshVisibleGrid(player, game->snapshot, game->changedCells,
+                                                          game->numChangedCells);
+      }
+
+      // the view may have changed; it has if it hashes differently to
+      // what was last sent
+      bool changed = false;
+      if (players->viewChanged[index]){
+        players->viewChanged[index] = false;
+        frame->hash = grid_viewHash(game->snapshot, players->visibleGrid[index]);
+        changed = frame->hash != game->sentHash[index];
+      }
 
-        mem_free(gridString);
-        free(message);
+      if (changed){
+        frame->grid = players->visibleGrid[index];
+        game->sentHash[index] = frame->hash;
+      } else {
+        frame->suppressed = true;
+      }
     }
+  }
 
-    if (game->spectator != NULL){
-        char* gridString = grid_getDisplay(game->masterGrid);
-        int gridLen = strlen(gridString);
-        int length = displayLen + gridLen;
+  if (frame->grid == game->snapshot){
+    frame->hash = grid_viewHash(game->snapshot, game->snapshot);
+  }
+}
 
-        char* message = mem_calloc_assert(length + 1, sizeof(char), "Could not allocate memory for display grid of each player.\n");
-        snprintf(message, length, "DISPLAY\n%s", gridString);
-        spectator_sendMessage(game->spectator, message);
+/****************** sendTask ******************************
+ *
+ * step 3 for one distinct frame: send it to every recipient
+ * sharing the frame. A player's frame is composed into this
+ * worker's buffer, and the spectator's is the snapshot string;
+ * either goes to the kernel as is, behind the DISPLAY header, so
+ * nothing else is copied or allocated.
+ *
+ * runs on a worker thread, so it must not touch the mem_ counters
+ *
+ */
+static void
+sendTask(void* arg, const int index, const int worker)
+{
+  game_t* game = arg;
+  playertable_t* players = game->players;
+  int owner = game->distinct[index];
+  const char* display = grid_composeView(game->snapshot, game->frames[owner].grid,
+                                                        game->buffers[worker]);
+
+  for (int i = owner; i <= players->count; ++i){
+    if (game->frames[i].grid == NULL || game->frames[i].owner != owner){
+      continue;
+    }
+    if (i == players->count){
+      sendFrame(game, MaxPlayers, spectator_getAddress(game->spectator),
+                                                       display, worker);
+    } else {
+      sendFrame(game, i, players->address[i], display, worker);
+    }
+  }
+}
 
-        mem_free(gridString);
-        free(message);
+/****************** sendFrame *****************************
+ *
+ * sends a display to the recipient in a slot: as a DISPLAY, or as
+ * a DELTA from the last display they were sent if they asked for
+ * MODE DELTA
+ *
+ * runs on a worker thread, so it must not touch the mem_ counters
+ *
+ */
+static void
+sendFrame(game_t* game, const int slot, const addr_t address,
+          const char* display, const int worker)
+{
+  // the player whose traced KEY this is gets it echoed in the header
+  char trace[80] = "";
+  if (slot == game->traceSlot){
+    traceSuffix(game, trace, sizeof(trace));
+  }
+
+  char header[120];
+  if (!game->wantsDelta[slot]){
+    if (trace[0] == '\0'){
+      message_sendParts(address, "DISPLAY\n", display);
+    } else {
+      snprintf(header, sizeof(header), "DISPLAY%s\n", trace);
+      message_sendParts(address, header, display);
     }
+    return;
+  }
+
+  snprintf(header, sizeof(header), "DELTA %u%s\n", ++game->frameNumber[slot], trace);
+  delta_encode(display, game->lastSent[slot], grid_numrows(game->snapshot),
+               grid_numcols(game->snapshot), game->deltas[worker]);
+  message_sendParts(address, header, game->deltas[worker]);
+}
+
+/****************** traceSuffix ***************************
+ *
+ * writes " seq received sent" into buf for the traced KEY, where received
+ * is when the KEY came and sent is now, both in microseconds; returns the
+ * length written
+ *
+ */
+static int
+traceSuffix(game_t* game, char* buf, const size_t size)
+{
+  return snprintf(buf, size, " %lu %lld %lld", game->traceSeq,
+                  game->traceReceived, microsNow());
+}
+
+/****************** microsNow *****************************
+ *
+ * returns the current time in microseconds
+ *
+ */
+static long long
+microsNow(void)
+{
+  struct timespec ts;
+  timespec_get(&ts, TIME_UTC);
+  return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
 }
 
 // A helper function that returns the result string
@@ -459,15 +925,15 @@ static char* get_result(game_t* game){
 
     int lineLength = MaxNameLength + 20;
 
-    // need to malloc to return from function
-    char* gameOverMessage = mem_calloc_assert(message_MaxBytes, sizeof(char), "out of memory\n");
+    // this is returned, so it can't be on the stack
+    char* gameOverMessage = mem_assert(arena_alloc(game->scratch, message_MaxBytes), "out of memory\n");
     sprintf(gameOverMessage, "QUIT GAME OVER:\n");
 
-    for(int i = 0; i < game->numPlayer; ++i){
-        player_t* player = game->players[i];
+    playertable_t* players = game->players;
+    for(int i = 0; i < players->count; ++i){
         char line[lineLength];
 
-        snprintf(line, lineLength, "%c %10d %s\n", player_getLetter(player), player_getGold(player), player_getName(player));
+        snprintf(line, lineLength, "%c %10d %s\n", players->letter[i], players->gold[i], players->name[i]);
         strncat(gameOverMessage, line, lineLength);
     }
 
@@ -477,60 +943,68 @@ static char* get_result(game_t* game){
 // to delete everything in the game that was initialized before. Check game.h for more information. 
 void game_over(game_t* game){
 
-    // get the result of the game
+    mem_phasePush("game over");
+
+    // get the result of the game; it lives in the scratch arena
     char* result = get_result(game);
+    flog_d(stderr, "game_over: %d unchanged DISPLAY frames were not sent", (int) game->numSuppressed);
 
     /************* delete players ************/
-    // to delete each player one by one
-    // sending each one the result before deleting
+    // send each player the result, then delete them all
 
-    for (int i = 0; i < game->numPlayer; i++){
-        player_sendMessage(game->players[i], result);
-        player_delete(game->players[i]);
+    playertable_t* players = game->players;
+    for (int i = 0; i < players->count; i++){
+        message_send(players->address[i], result);
     }
+    playertable_delete(players);
 
-    free(result);
-
-
-    // and then free the array of players too
-    mem_free(game->players);
-
-    // delete spectator
+    // delete spectator, after sending the result there too
     if (game->spectator != NULL){
       spectator_sendMessage(game->spectator, result);
       spectator_delete(game->spectator);
     }
     // delete grid
     grid_delete(game->masterGrid);
+    // stop the worker pool
+    jobs_delete(game->jobs);
+    // the player table, the broadcast bookkeeping and the result all go
+    // in one go with the arenas
+    arena_delete(game->scratch);
+    arena_delete(game->arena);
     // free game structure
     mem_free(game);
+
+    mem_phasePop();
 }
 
-/****************** findPlayerByCoords ********************
+/****************** movePlayer ****************************
  *
- * returns the player at the given coordinates
+ * moves player id by (dx, dy), after grid_movePlayer has moved
+ * them on the master grid, or found someone standing there to swap
+ * places with
  *
  */
-static player_t*
-findPlayerByCoords(game_t* game, const int x, const int y)
+static void
+movePlayer(game_t* game, const int id, const int dx, const int dy, const bool swap)
 {
-  if (game == NULL){
-    return NULL;
-  }
-
-  // we HAVE to do this search, we can't check with the grid
-  // because the grid is decoupled from game state
-  // (when we used the grid to quicken the process it resulted in
-  // bugs)
-  player_t** players = game->players;
-  for (int i = 0; i < game->numPlayer; ++i) {
-    player_t* player = players[i];
-    if (player_isActive(player) && player_getX(player) == x
-                                && player_getY(player) == y){
-      return player;
+  playertable_t* players = game->players;
+  int px = players->x[id];
+  int py = players->y[id];
+
+  if (swap){
+    grid_swapPlayers(game->masterGrid, px, py, px + dx, py + dy);
+
+    // we HAVE to do this search, we can't check with the grid
+    // because the grid is decoupled from game state
+    // (when we used the grid to quicken the process it resulted in
+    // bugs)
+    int other = playertable_findAt(players, px + dx, py + dy);
+    if (other >= 0){
+      players->x[other] = px;
+      players->y[other] = py;
     }
   }
 
-  return NULL;
+  players->x[id] = px + dx;
+  players->y[id] = py + dy;
 }
-
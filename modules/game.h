@@ -13,6 +13,7 @@
 #include "grid.h"
 #include "player.h"
 #include "spectator.h"
+#include "arena.h"
 
 #ifndef GAME_H
 #define GAME_H
@@ -23,6 +24,7 @@ typedef struct game game_t;
 /**
  * Caller provides: 
  *  @param mapfile as a FILE pointer 
+ *  @param sightRadius how many cells away players can see; 0 for no limit
  * 
  * We do: 
  *  Initialize the game by allocating memory for players, spectators.
@@ -32,8 +34,10 @@ typedef struct game game_t;
  *  The initialized game_t, NULL if any failure.
  * 
  * Notes:
+ *  With no limit players see as far as nothing blocks their view; a limit
+ *  keeps the cost of each move the same however big the map is.
 */
-game_t* game_init(FILE* mapfile);
+game_t* game_init(FILE* mapfile, const int sightRadius);
 
 
 /************* game_addPlayer *************/
@@ -41,17 +45,19 @@ game_t* game_init(FILE* mapfile);
 
  * Caller provides: 
  *  @param game structure pointer, 
- *  @param player structure pointer
+ *  @param player structure pointer, made by player_new in this game's
+ *  player table (see game_getPlayers)
  * 
  * We do:
- *  if there are less than 26 player in the game and the player has not joined the game before,
- *  (ehich means that player is not in players array) then add it to player array.
- *  Otherwise, send an error messsage and the request to join the game should be denied. 
+ *  put the player on the map and send everyone their new display.
+ *  A player from any other table is refused with an error on stderr.
  *  
  * We return:
  *  NULL
  * 
  * Notes:
+ *  the table holds at most 26 players, so player_new returns NULL once
+ *  the game is full.
 */
 void game_addPlayer(game_t* game, player_t* player);
 
@@ -133,6 +139,45 @@ void game_removeSpectator(game_t* game, addr_t address);
  */
 grid_t* game_masterGrid(game_t* game);
 
+/****************** game_arena ****************************
+ *
+ * Returns the arena that lives as long as the game, e.g. for players
+ *
+ * Caller provides:
+ *  Valid pointer to game
+ * We return:
+ *  The game's arena; everything allocated from it is freed by game_over
+ *  NULL on error
+ */
+arena_t* game_arena(game_t* game);
+
+/****************** game_scratch **************************
+ *
+ * Returns the arena for memory that is only needed while handling one
+ * message, e.g. for building replies
+ *
+ * Caller provides:
+ *  Valid pointer to game
+ * We return:
+ *  The game's scratch arena
+ *  NULL on error
+ * Notes:
+ *  Everything allocated from it is freed at once by game_resetScratch.
+ */
+arena_t* game_scratch(game_t* game);
+
+/****************** game_resetScratch *********************
+ *
+ * Frees everything allocated from the scratch arena
+ *
+ * Caller provides:
+ *  Valid pointer to game
+ * Notes:
+ *  Call this before handling each message. The scratch arena keeps its
+ *  memory, so once it has grown big enough it no longer allocates.
+ */
+void game_resetScratch(game_t* game);
+
 /****************** game_numPlayers ********************
  *
  * Returns the number of players that have joined the game
@@ -147,24 +192,92 @@ grid_t* game_masterGrid(game_t* game);
 int game_numPlayers(game_t* game);
 
 
+/****************** game_setDeltaMode *********************
+ *
+ * Switches a player or the spectator to DELTA messages in place of
+ * DISPLAY, or starts their DELTAs again from scratch
+ *
+ * Caller provides:
+ *  Valid pointer to game
+ *  the address of the player or spectator (who sent MODE DELTA)
+ * We do:
+ *  Send them, from now on, only the cells that changed since the last
+ *  frame they were sent, as
+ *    DELTA n
+ *    row col text
+ *    ...
+ *  where n counts the DELTAs sent to them (from 1), and each line
+ *  replaces the cells of that row from col on with text. The first, sent
+ *  at once, is from a blank screen (all spaces).
+ * We return:
+ *  true if they are in the game, false if not
+ * Notes:
+ *  A client that misses a DELTA (it skips a number) sends MODE DELTA again
+ *  to start over.
+ */
+bool game_setDeltaMode(game_t* game, addr_t address);
+
+
+/****************** game_traceKey *************************
+ *
+ * Marks the KEY about to be handled as carrying a sequence number
+ *
+ * Caller provides:
+ *  Valid pointer to game
+ *  the address the KEY came from, and its sequence number
+ * We do:
+ *  Until game_endTrace, add " seq received sent" to the header line of
+ *  the DISPLAY or DELTA, and to the GOLD message, sent to that player;
+ *  received is now and sent is when each goes out, both in microseconds
+ *  of the server's clock. Nothing is added if the address is not a
+ *  player's
+ * Notes:
+ *  sent - received is the time the server spent on the KEY, so a client
+ *  can tell it apart from the time on the network without the two
+ *  clocks agreeing
+ */
+void game_traceKey(game_t* game, addr_t address, const unsigned long seq);
+
+
+/****************** game_endTrace *************************
+ *
+ * Stops echoing the KEY marked by game_traceKey; call once it has been
+ * handled, so frames caused by later KEYs do not carry it
+ */
+void game_endTrace(game_t* game);
+
+
+/****************** game_numSuppressedFrames **************
+ *
+ * Returns the number of DISPLAY frames that were not sent because the
+ * recipient's view was exactly what they had last been sent
+ *
+ * Caller provides:
+ *  Valid pointer to game
+ * We return:
+ *  the number of suppressed frames so far
+ *  0 on error
+ */
+unsigned long game_numSuppressedFrames(game_t* game);
+
+
 /************* game_getPlayers *************/
-/** Return the array of players
+/** Return the table of players
 
  * Caller provides: 
  *  @param game structure pointer, 
  * 
  * We do:
- *  Get the array of the players pointers. It is possible for the array to be NULL.
- *  The array is not always full, which means that there are some free spots for the 
- *  empty space on the arrray
+ *  Get the table holding every player who has joined the game, for
+ *  player_new to add players to
  * 
  * We return:
- *  A pointer to the array of players (player_t*)
+ *  A pointer to the player table, NULL on error
  * 
  * Notes:
- *  The array can be null with zero player. The caller should take care of that. 
+ *  The table belongs to the game, and is freed by game_over.
 */
-player_t** game_getPlayers(game_t* game);
+playertable_t* game_getPlayers(game_t* game);
 
 /************* game_getGold *************/
 /** Return the amount of players
@@ -4,6 +4,13 @@
  *
  * usage and description is given in grid.h
  *
+ * The grid allocates with malloc, not from the game's arenas: a player's
+ * visible grid is first made on one of the game's pool threads, and an
+ * arena is not thread-safe; and the grid is used without a game, by its
+ * tests and composebench. None of it is allocated per key, either. Each
+ * visible grid is made once, snapshots are recycled once there are enough,
+ * and the region index is built with the map; grid_delete frees them.
+ *
  * Ribhu Hooja, February 2024
  */
 
@@ -11,32 +18,136 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <stdatomic.h>
+#include <sched.h>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define GRID_X86      // the blend kernels below can use SSE2 and AVX2
+#endif
 #include "grid.h"
 #include "mem.h"
 #include "counters.h"
-#include "hashtable.h"
 #include "mapchars.h"
 
 /****************** types ********************************/
 typedef struct grid {
-  char* string;         // the string representation of the grid
+  char* string;         // the string representation of the grid; NULL for
+                        // player grids, whose display is composed on demand
+  char* base;           // the terrain alone, without gold or players; this never
+                        // changes after loading, so snapshots share it
   int numrows;          // number of rows
   int numcols;          // number of columns
+  int sightRadius;      // how far players can see; 0 for no limit; master
+                        // grid and snapshots
   counters_t* nuggets;  // number of nuggets at a location, keyed by string index
-  hashtable_t* playersStandingOn;   // what character each player is standing on
+  char* playersStandingOn;  // what character each player is standing on,
+                            // indexed by player letter; master grid only
+  struct snapshots* snapshots;      // published snapshots; master grid only
+  struct regions* regions;  // the rooms and passages of the map; like the base,
+                            // shared by the master grid and its snapshots
+  char* tileKinds;      // what terrain each tile holds (see rockTile etc.);
+                        // shared like the regions
+  int numChanged;       // cells changed by the last visibility update; player grids only
+  bool* tiles;          // which tiles hold a currently visible cell; player grids only
+  unsigned long* seen;  // bit per string index: ever seen (newlines always are);
+                        // player grids only
+  unsigned long* visible;   // bit per string index: in view now; player grids only
+  int selfIndex;        // string index of the player; player grids only
 } grid_t;
 
+/* A snapshot is an immutable copy of the dynamic layer (the grid string)
+ * of the master grid, published with grid_publish. It is itself a grid_t,
+ * sharing the base terrain of the master, so the read-only grid functions
+ * work on it unchanged.
+ */
+typedef struct snapshot {
+  grid_t grid;                  // must be first; readers are handed &grid
+  unsigned long version;        // which publish produced this snapshot
+  unsigned long retiredAt;      // epoch at which it was replaced
+  struct snapshot* next;        // next in the retired or free list
+  int numChangedCells;          // cells changed since the previous snapshot,
+                                // or -1 if unknown
+  int changedCells[256];        // their string indices; size must match
+                                // maxChangedCells
+} snapshot_t;
+
+/* A region is a room or a passage: a maximal set of room spots, or of
+ * passage spots, joined up side to side or corner to corner. grid_fromMap
+ * finds them all once, from the terrain.
+ */
+typedef struct region {
+  bool isRoom;          // made of room spots, rather than passage spots
+  bool isRectangle;     // a room that fills its bounding box exactly
+  int left, top;        // bounding box of its cells, inclusive
+  int right, bottom;
+  int firstCell;        // its cells are regions_t.cells[firstCell...]
+  int numCells;
+  int firstDoor;        // for a rectangle, the passage spots in the ring
+  int numDoors;         // just outside it, in regions_t.doors[firstDoor...]
+} region_t;
+
+typedef struct regions {
+  int* regionOf;        // region of each string index; -1 if none
+  region_t* list;       // every region; rooms first
+  int numRegions;
+  int numRooms;
+  int* cells;           // string indices of the cells of every region
+  int* doors;           // string indices of the doors of every rectangle
+} regions_t;
+
+/* Epoch-based reclamation for snapshots. A reader records the epoch it
+ * started in before it loads the current snapshot. When the writer replaces
+ * a snapshot it advances the epoch, so any reader that records the new epoch
+ * or a later one cannot see the old snapshot; once no reader is still in an
+ * older epoch the old snapshot can be reused. Neither side ever blocks.
+ */
+typedef struct snapshots {
+  _Atomic(snapshot_t*) current;         // the newest published snapshot
+  atomic_ulong epoch;                   // current epoch; starts at 1
+  atomic_ulong readers[32];             // each reader's epoch, or 0 if free
+  snapshot_t* retired;                  // replaced, maybe still being read
+  snapshot_t* free;                     // ready to be reused
+  unsigned long version;                // number of snapshots published
+  bool dirty;                           // has the string changed since?
+  int numChangedCells;                  // cells changed since then, or -1 if
+                                        // there were too many to list
+  int changedCells[256];                // their string indices
+} snapshots_t;
+
 /****************** file-local global variables **********/
-/* none */
+// whether grid_composeView may use vector instructions; see grid_useSimd
+static bool useSimd = true;
+// whether visibility uses the room index; see grid_useRoomIndex
+static bool useRoomIndex = true;
+// whether visibility skips tiles that cannot be seen; see grid_useTileCulling
+static bool useTileCulling = true;
 
 /****************** file-local global constants **********/
 // the initial string size allocated when reading a grid from a file
 static const int initGridStringSize = 2000; 
-// number of slots in the playerStandingOn hashtable
-static const int numSlotsPlayerHt = 26;
+// number of entries in the playersStandingOn array, one for every char value
+static const int numStandingOn = 256;
 // number of times we attempt to find a spot to spawn a player before switching
 // algorithms
 static const int numAttemptsSpawning = 100;
+// number of snapshot readers that can be active at once; must match the
+// size of snapshots_t.readers
+static const int maxSnapshotReaders = 32;
+// number of changed cells a snapshot lists before it just says "everything";
+// must match the size of snapshot_t.changedCells and snapshots_t.changedCells
+static const int maxChangedCells = 256;
+// width and height of the square tiles the grid is divided into
+static const int tileSize = 8;
+// the kinds of terrain a tile can hold, in grid_t.tileKinds
+static const char rockTile = 0;     // solid rock only; never in view
+static const char openTile = 1;     // room spots only; see through it
+static const char mixedTile = 2;    // anything else
+// how much of a tile a player can see, as found by tileView
+static const int seesNone = 0;      // no cell of it
+static const int seesAll = 1;       // every cell that is not solid rock
+static const int seesSome = 2;      // test each cell
+// number of cells in each word of a player grid's bitsets
+static const int bitsPerWord = sizeof(unsigned long) * 8;
 
 /****************** global constants *********************/
 /* the map characters are defined as global constants here;
@@ -68,8 +179,40 @@ static bool isBlockedHorizontally(grid_t* grid, const int px, const int py,
                                                 const int x,  const int y);
 static bool isBlockedVertically(grid_t* grid, const int px, const int py,
                                               const int x,  const int y);
-static bool isBlocking(grid_t* grid, const int x, const int y);
-static void freeCharItemdelete(void* pChar);
+static inline int tileOf(const int x, const int y, const int numcols);
+static regions_t* findRegions(const char* base, const int numrows,
+                                                const int numcols);
+static int fillRegion(const char* base, const int numrows, const int numcols,
+                      const int start, int* regionOf, int* cells, const int id);
+static region_t* rectangleAt(grid_t* grid, const int x, const int y,
+                                                         bool* pDoorsOpen);
+static char* summarizeTiles(const char* base, const int numrows,
+                                              const int numcols);
+static int tileView(grid_t* grid, const int tileX, const int tileY,
+                    const int px, const int py, region_t* room,
+                    const bool doorsOpen);
+static inline bool isWithinSight(grid_t* grid, const int px, const int py,
+                                               const int x, const int y);
+static inline int numTiles(const int numrows, const int numcols);
+static inline bool testBit(const unsigned long* bits, const int index);
+static inline int countBits(const unsigned long word);
+static inline char displayCharAt(grid_t* grid, grid_t* visibleGrid,
+                                               const int index);
+static void blendScalar(char* out, const char* current, const char* base,
+                        const unsigned long visible, const unsigned long seen,
+                        const int n);
+#ifdef GRID_X86
+static void blendSSE2(char* out, const char* current, const char* base,
+                      const unsigned long visible, const unsigned long seen,
+                      const int n);
+static void blendAVX2(char* out, const char* current, const char* base,
+                      const unsigned long visible, const unsigned long seen,
+                      const int n);
+#endif
+static bool blocksSight(const char toCheck);
+static void markChanged(grid_t* grid, const int index, const char oldChar);
+static void reclaimSnapshots(snapshots_t* snapshots);
+static void freeSnapshotList(snapshot_t* list);
 
 /****************** global function prototypes ***********/
 /* see grid.h for description and usage */
@@ -99,7 +242,7 @@ grid_t* grid_fromMap(FILE* mapFile){
     }
 
     // expand the string buffer if needed
-    if (numcols > stringBufSize){
+    if (numcols >= stringBufSize){
       stringBufSize *= 2;
       string = realloc(string, stringBufSize * sizeof(char));
       mem_assert(string, "out of memory\n");
@@ -120,7 +263,7 @@ grid_t* grid_fromMap(FILE* mapFile){
     }
 
     // expand the string buffer if needed
-    if (i > stringBufSize){
+    if (i >= stringBufSize){
       stringBufSize *= 2;
       string = realloc(string, stringBufSize * sizeof(char));
       mem_assert(string, "out of memory\n");
@@ -152,15 +295,47 @@ grid_t* grid_fromMap(FILE* mapFile){
   new->string = string;
   new->numrows = numrows;
   new->numcols = numcols;
+  new->sightRadius = 0;
+
+  // the map file holds only terrain, so it is also the base layer
+  new->base = malloc((i + 1) * sizeof(char));
+  mem_assert(new->base, "out of memory\n");
+  memcpy(new->base, string, i + 1);
+
+  snapshots_t* snapshots = malloc(sizeof(snapshots_t));
+  mem_assert(snapshots, "out of memory; could not allocate space for snapshots\n");
+  atomic_init(&snapshots->current, NULL);
+  atomic_init(&snapshots->epoch, 1);
+  for (int r = 0; r < maxSnapshotReaders; ++r){
+    atomic_init(&snapshots->readers[r], 0);
+  }
+  snapshots->retired = NULL;
+  snapshots->free = NULL;
+  snapshots->version = 0;
+  snapshots->dirty = true;
+  snapshots->numChangedCells = -1;      // nothing has been published yet
+  new->snapshots = snapshots;
+  new->numChanged = 0;
+  new->tiles = NULL;
+  new->seen = NULL;
+  new->visible = NULL;
+  new->selfIndex = -1;
 
   counters_t* ctrs = counters_new();
   mem_assert(ctrs, "out of memory; could not allocate space for nuggets counter\n");
 
-  hashtable_t* ht = hashtable_new(numSlotsPlayerHt);
-  mem_assert(ht, "out of memory; could not allocate space for player hashtable\n");
+  // until they are placed, players are taken to be standing on a room spot
+  char* standingOn = malloc(numStandingOn * sizeof(char));
+  mem_assert(standingOn, "out of memory; could not allocate space for players\n");
+  memset(standingOn, mapchars_roomSpot, numStandingOn);
 
   new->nuggets = ctrs;
-  new->playersStandingOn = ht;
+  new->playersStandingOn = standingOn;
+
+  // the rooms and passages never change, so they are found once,
+  // as is what each tile holds
+  new->regions = findRegions(new->base, numrows, numcols);
+  new->tileKinds = summarizeTiles(new->base, numrows, numcols);
   
   return new;
 }
@@ -186,7 +361,34 @@ grid_delete(grid_t* grid)
   }
 
   if (grid->playersStandingOn != NULL){ 
-    hashtable_delete(grid->playersStandingOn, freeCharItemdelete); 
+    free(grid->playersStandingOn);
+  }
+
+  if (grid->tiles != NULL){
+    free(grid->tiles);
+  }
+
+  if (grid->seen != NULL){
+    free(grid->seen);
+    free(grid->visible);
+  }
+
+  // snapshots share the base, so only the master frees it
+  if (grid->snapshots != NULL){
+    snapshots_t* snapshots = grid->snapshots;
+    freeSnapshotList(atomic_load(&snapshots->current));
+    freeSnapshotList(snapshots->retired);
+    freeSnapshotList(snapshots->free);
+    free(snapshots);
+    free(grid->base);
+    if (grid->regions != NULL){
+      free(grid->regions->regionOf);
+      free(grid->regions->list);
+      free(grid->regions->cells);
+      free(grid->regions->doors);
+      free(grid->regions);
+    }
+    free(grid->tileKinds);
   }
 
   free(grid);
@@ -259,6 +461,11 @@ grid_baseCharAt(grid_t* grid, const int x, const int y)
 
   char toCheck = grid_charAt(grid, x, y);
 
+  // the master grid and its snapshots keep the terrain layer around
+  if (grid->base != NULL && toCheck != '\0'){
+    return grid->base[indexOf(x, y, grid->numcols)];
+  }
+
   if (toCheck == '\0' || toCheck == mapchars_solidRock
                       || toCheck == mapchars_roomSpot
                       || toCheck == mapchars_passageSpot
@@ -339,6 +546,7 @@ grid_nuggetsPopulate(grid_t* grid, const int minNumPiles, const int maxNumPiles,
     int chosenSpot = rand() % stringLength;
     if (string[chosenSpot] == mapchars_roomSpot){
       string[chosenSpot] = mapchars_gold;
+      markChanged(grid, chosenSpot, mapchars_roomSpot);
       spots[i] = chosenSpot;
       counters_set(nuggets, chosenSpot, 0);
       ++i;
@@ -374,50 +582,229 @@ grid_generateVisibleGrid(grid_t* grid, grid_t* currentlyVisibleGrid, const int p
       return NULL;
   }
 
+  int length = numrows * (numcols + 1);
+  int numWords = (length + bitsPerWord - 1) / bitsPerWord;
+
   // this means that the visibility check has never been performed before
-  // start off the player with all map spots blank i.e. solid rock
+  // start off the player having seen nothing, i.e. all solid rock
   if (currentlyVisibleGrid == NULL){
     grid_t* new = malloc(sizeof(grid_t));
     mem_assert(new, "out of memory; could not make new grid for visibility\n");
  
     new->numrows = numrows;
     new->numcols = numcols;
+    new->sightRadius = 0;
+    new->string = NULL;    // composed from the master grid when displayed
     new->nuggets = NULL;   // NUGGETS INFO MUST NOT BE ACCESSED FROM PLAYER GRIDS
     new->playersStandingOn = NULL; // ALSO SHOULD NOT BE ACCESSED FROM PLAYER GRIDS
- 
-    int len = numrows * (numcols + 1);
-    char* newString = calloc(len + 1, sizeof(char)); // plus one for nullchar
-    for (int i = 0; i < len; ++i){
-      if (i % (numcols + 1) == numcols){
-        newString[i] = '\n';
-      } else {
-        newString[i] = mapchars_solidRock;
-      }
+    new->base = NULL;
+    new->regions = NULL;
+    new->tileKinds = NULL;
+    new->snapshots = NULL;
+    new->numChanged = 0;
+    new->tiles = calloc(numTiles(numrows, numcols), sizeof(bool));
+    new->seen = calloc(numWords, sizeof(unsigned long));
+    new->visible = calloc(numWords, sizeof(unsigned long));
+    mem_assert(new->tiles, "out of memory; could not make new grid for visibility\n");
+    mem_assert(new->seen, "out of memory; could not make new grid for visibility\n");
+    mem_assert(new->visible, "out of memory; could not make new grid for visibility\n");
+
+    // the newlines are always shown, and the base layer has them too
+    for (int y = 0; y < numrows; ++y){
+      int index = indexOf(numcols, y, numcols);
+      new->seen[index / bitsPerWord] |= 1UL << (index % bitsPerWord);
     }
-    newString[len] = '\0';
-    new->string = newString;
+    new->selfIndex = -1;
     currentlyVisibleGrid = new;
   }
 
-  char* currString = currentlyVisibleGrid->string;
-  for (int x = 0; x < numcols; ++x){
-    for (int y = 0; y < numrows; ++y){
-      int index = indexOf(x, y, numcols);
-      if (isVisible(grid, px, py, x, y)){
-        currString[index] = grid_charAt(grid, x, y);
-      } else if (currString[index] != mapchars_solidRock) {
-        // if a point hasn't been seeen before, it is solid rock
-        currString[index] = grid_baseCharAt(grid, x, y);
-      } // else the point hasn't been seen before, so let it remain solid rock
-        // no action required
+  // the tiles in view are worked out afresh along with the cells
+  bool* tiles = currentlyVisibleGrid->tiles;
+  memset(tiles, 0, numTiles(numrows, numcols) * sizeof(bool));
+
+  // in a rectangular room, everything up to and including the ring of
+  // walls around it is in view, and nothing beyond it is unless a player
+  // standing in one of its doorways lets light through; only then, and
+  // only for the cells outside the ring, are rays needed
+  bool doorsOpen = false;
+  region_t* room = rectangleAt(grid, px, py, &doorsOpen);
+  int left = room == NULL ? 0 : room->left - 1;
+  int top = room == NULL ? 0 : room->top - 1;
+  int right = room == NULL ? -1 : room->right + 1;
+  int bottom = room == NULL ? -1 : room->bottom + 1;
+
+  // with a sight radius, only the rows within it can hold anything in
+  // view; the words wholly outside them are simply cleared
+  int firstRow = 0;
+  int lastRow = numrows - 1;
+  if (grid->sightRadius > 0){
+    firstRow = py - grid->sightRadius > 0 ? py - grid->sightRadius : 0;
+    lastRow = py + grid->sightRadius < numrows - 1 ? py + grid->sightRadius
+                                                   : numrows - 1;
+  }
+  int firstIndex = indexOf(0, firstRow, numcols);
+  int lastIndex = indexOf(numcols, lastRow, numcols);
+  unsigned long* visible = currentlyVisibleGrid->visible;
+  unsigned long* seen = currentlyVisibleGrid->seen;
+  int numChanged = 0;
+  for (int w = 0; w < numWords; ++w){
+    if (w < firstIndex / bitsPerWord || w > lastIndex / bitsPerWord){
+      numChanged += countBits(visible[w]);
+      visible[w] = 0;
     }
   }
 
-  currentlyVisibleGrid->string[indexOf(px, py, numcols)] = mapchars_player;
+  // go through the cells of those rows in string order, a word of bits at
+  // a time; any cell in view now or before may show something different.
+  // Solid rock always looks the same, so it is never taken to be in
+  // view, and whole tiles that cannot be seen are passed over
+  const char* base = grid->base;
+  unsigned long word = 0;
+  int index = firstIndex;
+  int view = seesSome;
+  for (int y = firstRow; y <= lastRow; ++y){
+    for (int x = 0; x <= numcols; ++x, ++index){
+      if (x % tileSize == 0 && x < numcols){
+        view = tileView(grid, x / tileSize, y / tileSize, px, py, room, doorsOpen);
+      }
+
+      bool inView;
+      if (x == numcols || view == seesNone || base[index] == mapchars_solidRock
+                       || !isWithinSight(grid, px, py, x, y)){
+        inView = false;     // a newline, or nothing to see
+      } else if (view == seesAll){
+        inView = true;
+      } else if (x >= left && x <= right && y >= top && y <= bottom){
+        inView = true;      // in the room the player is in, or its walls
+      } else if (room != NULL){
+        inView = doorsOpen && isVisible(grid, px, py, x, y);
+      } else {
+        inView = (x == px && y == py) || isVisible(grid, px, py, x, y);
+      }
+
+      if (inView){
+        word |= 1UL << (index % bitsPerWord);
+        tiles[tileOf(x, y, numcols)] = true;
+      }
+
+      if (index % bitsPerWord == bitsPerWord - 1 || index == lastIndex){
+        int w = index / bitsPerWord;
+        numChanged += countBits(visible[w] | word);
+        visible[w] = word;
+        seen[w] |= word;
+        word = 0;
+      }
+    }
+  }
 
+  currentlyVisibleGrid->selfIndex = indexOf(px, py, numcols);
+  currentlyVisibleGrid->numChanged = numChanged;
   return currentlyVisibleGrid;
 }
 
+/****************** grid_refreshVisibleGrid ***************
+ *
+ * see grid.h for usage and description
+ *
+ */
+bool
+grid_refreshVisibleGrid(grid_t* grid, grid_t* visibleGrid, const int px,
+                        const int py, const int* cells, const int numCells)
+{
+  if (grid == NULL || visibleGrid == NULL || visibleGrid->visible == NULL
+                   || (cells == NULL && numCells > 0)){
+    return false;
+  }
+
+  int numcols = grid->numcols;
+  if (!isValidCoordinate(px, py, grid->numrows, numcols)){
+    return false;
+  }
+
+  // the player hasn't moved, so what they can see hasn't changed, and
+  // the bits stay as they are; only the given cells that are in view
+  // show anything different
+  int numChanged = 0;
+  for (int i = 0; i < numCells; ++i){
+    int x, y;
+    getCoordsFromIndex(cells[i], numcols, &x, &y);
+    if (visibleGrid->tiles[tileOf(x, y, numcols)]
+        && testBit(visibleGrid->visible, cells[i])){
+      ++numChanged;
+    }
+  }
+
+  visibleGrid->numChanged = numChanged;
+  return true;
+}
+
+/****************** grid_numTiles *************************
+ *
+ * see grid.h for usage and description
+ *
+ */
+int
+grid_numTiles(grid_t* grid)
+{
+  if (grid == NULL){
+    return 0;
+  }
+
+  return numTiles(grid->numrows, grid->numcols);
+}
+
+/****************** grid_tileOfCell ***********************
+ *
+ * see grid.h for usage and description
+ *
+ */
+int
+grid_tileOfCell(grid_t* grid, const int index)
+{
+  if (grid == NULL || index < 0 || index >= (grid->numcols + 1) * grid->numrows){
+    return -1;
+  }
+
+  int x, y;
+  getCoordsFromIndex(index, grid->numcols, &x, &y);
+  if (x >= grid->numcols){
+    return -1;    // a newline
+  }
+
+  return tileOf(x, y, grid->numcols);
+}
+
+/****************** grid_seesTile *************************
+ *
+ * see grid.h for usage and description
+ *
+ */
+bool
+grid_seesTile(grid_t* visibleGrid, const int tile)
+{
+  if (visibleGrid == NULL || visibleGrid->tiles == NULL || tile < 0
+               || tile >= numTiles(visibleGrid->numrows, visibleGrid->numcols)){
+    return false;
+  }
+
+  return visibleGrid->tiles[tile];
+}
+
+/****************** grid_numChanged ***********************
+ *
+ * see grid.h for usage and description
+ *
+ */
+int
+grid_numChanged(grid_t* visibleGrid)
+{
+  if (visibleGrid == NULL){
+    return 0;
+  }
+
+  return visibleGrid->numChanged;
+}
+
 /****************** grid_findRandomSpawnPosition **********
  *
  * see grid.h for usage and description
@@ -492,8 +879,10 @@ grid_addPlayer(grid_t* grid, const int x, const int y, const char playerChar)
     return false;
   }
 
-  grid->string[indexOf(x, y, grid->numcols)] = playerChar;
+  int index = indexOf(x, y, grid->numcols);
+  grid->string[index] = playerChar;
   setPlayerStandingOn(grid, playerChar, mapchars_roomSpot);
+  markChanged(grid, index, mapchars_roomSpot);
 
   return true;
 }
@@ -562,6 +951,8 @@ grid_movePlayer(grid_t* grid, const int px, const int py, const int x_move,
   string[oldIndex] = getPlayerStandingOn(grid, playerChar);
   setPlayerStandingOn(grid, playerChar, newStandingOn);
   string[newIndex] = playerChar; 
+  markChanged(grid, oldIndex, playerChar);
+  markChanged(grid, newIndex, moveSpot);
 
   return gold;
 }
@@ -599,6 +990,8 @@ grid_swapPlayers(grid_t* grid, const int x1, const int y1, const int x2, const i
   char* string = grid->string;
   string[indexOne] = playerTwoChar;
   string[indexTwo] = playerOneChar;
+  markChanged(grid, indexOne, playerOneChar);
+  markChanged(grid, indexTwo, playerTwoChar);
   
   // update standing on
   char playerOneStandingOn = getPlayerStandingOn(grid, playerOneChar);
@@ -625,8 +1018,9 @@ grid_removePlayer(grid_t* grid, const char playerChar, const int px, const int p
     return false;
   }
 
-  grid->string[indexOf(px, py, grid->numcols)] = getPlayerStandingOn(grid,
-                                                                     playerChar);
+  int index = indexOf(px, py, grid->numcols);
+  grid->string[index] = getPlayerStandingOn(grid, playerChar);
+  markChanged(grid, index, playerChar);
 
   return true;
 }
@@ -662,7 +1056,7 @@ grid_collectGold(grid_t* grid, const int px, const int py)
 char*
 grid_getDisplay(grid_t* grid)
 {
-  if (grid == NULL){
+  if (grid == NULL || grid->string == NULL){
     return NULL;
   }
 
@@ -673,6 +1067,200 @@ grid_getDisplay(grid_t* grid)
   return string;
 }
 
+/****************** grid_displayLength ********************
+ *
+ * see grid.h for usage and description
+ *
+ */
+int
+grid_displayLength(grid_t* grid)
+{
+  if (grid == NULL){
+    return 0;
+  }
+
+  return (grid->numcols + 1) * grid->numrows;
+}
+
+/****************** grid_viewHash *************************
+ *
+ * see grid.h for usage and description
+ *
+ */
+unsigned long
+grid_viewHash(grid_t* grid, grid_t* visibleGrid)
+{
+  if (grid == NULL || grid->string == NULL || visibleGrid == NULL){
+    return 0;
+  }
+
+  // FNV-1a, 64 bit, over the display as grid_composeView would write it
+  unsigned long hash = 14695981039346656037UL;
+  int length = grid_displayLength(grid);
+  for (int i = 0; i < length; ++i){
+    hash ^= (unsigned char) displayCharAt(grid, visibleGrid, i);
+    hash *= 1099511628211UL;
+  }
+
+  return hash;
+}
+
+/****************** grid_viewEquals ***********************
+ *
+ * see grid.h for usage and description
+ *
+ */
+bool
+grid_viewEquals(grid_t* grid, grid_t* a, grid_t* b)
+{
+  if (grid == NULL || grid->string == NULL || a == NULL || b == NULL){
+    return false;
+  }
+
+  if (a == b){
+    return true;
+  }
+
+  int length = grid_displayLength(grid);
+  for (int i = 0; i < length; ++i){
+    if (displayCharAt(grid, a, i) != displayCharAt(grid, b, i)){
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/****************** grid_composeView **********************
+ *
+ * see grid.h for usage and description
+ *
+ */
+const char*
+grid_composeView(grid_t* grid, grid_t* visibleGrid, char* buffer)
+{
+  if (grid == NULL || grid->string == NULL || visibleGrid == NULL){
+    return NULL;
+  }
+
+  // a grid with a string of its own needs no composing
+  if (visibleGrid->string != NULL){
+    return visibleGrid->string;
+  }
+  if (buffer == NULL || visibleGrid->visible == NULL){
+    return NULL;
+  }
+
+  // the best blend kernel this machine has, for the words that need one
+  void (*blend)(char*, const char*, const char*, const unsigned long,
+                const unsigned long, const int) = blendScalar;
+#ifdef GRID_X86
+  if (useSimd && __builtin_cpu_supports("avx2")){
+    blend = blendAVX2;
+  } else if (useSimd && __builtin_cpu_supports("sse2")){
+    blend = blendSSE2;
+  }
+#endif
+
+  // a word of cells at a time; whole words in view, or never seen, are
+  // copied or filled in one go, and the rest blended under the masks
+  const char* current = grid->string;
+  const char* base = grid->base;
+  int length = grid_displayLength(grid);
+  for (int start = 0; start < length; start += bitsPerWord){
+    int n = length - start < bitsPerWord ? length - start : bitsPerWord;
+    unsigned long all = n == bitsPerWord ? ~0UL : (1UL << n) - 1;
+    unsigned long visible = visibleGrid->visible[start / bitsPerWord];
+    unsigned long seen = visibleGrid->seen[start / bitsPerWord];
+
+    if (visible == all){
+      memcpy(buffer + start, current + start, n);
+    } else if (seen == 0){
+      memset(buffer + start, mapchars_solidRock, n);
+    } else if (visible == 0 && seen == all){
+      memcpy(buffer + start, base + start, n);
+    } else {
+      blend(buffer + start, current + start, base + start, visible, seen, n);
+    }
+  }
+
+  buffer[visibleGrid->selfIndex] = mapchars_player;
+  buffer[length] = '\0';
+  return buffer;
+}
+
+/****************** grid_useSimd **************************
+ *
+ * see grid.h for usage and description
+ *
+ */
+bool
+grid_useSimd(const bool wanted)
+{
+  useSimd = wanted;
+
+#ifdef GRID_X86
+  return useSimd && __builtin_cpu_supports("sse2");
+#else
+  return false;
+#endif
+}
+
+/****************** grid_useRoomIndex *********************
+ *
+ * see grid.h for usage and description
+ *
+ */
+void
+grid_useRoomIndex(const bool wanted)
+{
+  useRoomIndex = wanted;
+}
+
+/****************** grid_setSightRadius *******************
+ *
+ * see grid.h for usage and description
+ *
+ */
+void
+grid_setSightRadius(grid_t* grid, const int radius)
+{
+  if (grid == NULL || grid->snapshots == NULL){
+    return;
+  }
+
+  // everyone's view may change, so the next snapshot says everything did
+  grid->sightRadius = radius > 0 ? radius : 0;
+  grid->snapshots->dirty = true;
+  grid->snapshots->numChangedCells = -1;
+}
+
+/****************** grid_useTileCulling *******************
+ *
+ * see grid.h for usage and description
+ *
+ */
+void
+grid_useTileCulling(const bool wanted)
+{
+  useTileCulling = wanted;
+}
+
+/****************** grid_displayView *********************
+ *
+ * see grid.h for usage and description
+ *
+ */
+const char*
+grid_displayView(grid_t* grid)
+{
+  if (grid == NULL){
+    return NULL;
+  }
+
+  return grid->string;
+}
+
 /****************** grid_toMap ****************************
  *
  * see grid.h for usage and description
@@ -685,13 +1273,170 @@ grid_toMap(grid_t* grid, FILE* fp)
     return;
   }
 
-  char* toPrint = grid_getDisplay(grid);
+  const char* toPrint = grid_displayView(grid);
   if (toPrint == NULL){
     return;
   }
 
   fputs(toPrint, fp);
-  free(toPrint);
+}
+
+/****************** grid_publish **************************
+ *
+ * see grid.h for usage and description
+ *
+ */
+unsigned long
+grid_publish(grid_t* grid)
+{
+  if (grid == NULL || grid->snapshots == NULL){
+    return 0;
+  }
+
+  snapshots_t* snapshots = grid->snapshots;
+  if (!snapshots->dirty){
+    return snapshots->version;
+  }
+
+  // reuse a snapshot nobody can be reading any more, if there is one
+  reclaimSnapshots(snapshots);
+  snapshot_t* new = snapshots->free;
+  int length = (grid->numcols + 1) * grid->numrows;
+  if (new != NULL){
+    snapshots->free = new->next;
+  } else {
+    new = malloc(sizeof(snapshot_t));
+    mem_assert(new, "out of memory; could not make new snapshot\n");
+    new->grid.string = malloc((length + 1) * sizeof(char));
+    mem_assert(new->grid.string, "out of memory; could not make new snapshot\n");
+    new->grid.base = grid->base;
+    new->grid.regions = grid->regions;
+    new->grid.tileKinds = grid->tileKinds;
+    new->grid.numrows = grid->numrows;
+    new->grid.numcols = grid->numcols;
+    new->grid.nuggets = NULL;             // snapshots are read-only views
+    new->grid.playersStandingOn = NULL;
+    new->grid.snapshots = NULL;
+    new->grid.numChanged = 0;
+    new->grid.tiles = NULL;
+    new->grid.seen = NULL;
+    new->grid.visible = NULL;
+    new->grid.selfIndex = -1;
+  }
+
+  memcpy(new->grid.string, grid->string, length + 1);
+  new->grid.sightRadius = grid->sightRadius;
+  new->version = ++snapshots->version;
+  new->next = NULL;
+
+  // hand the list of changed cells over to the snapshot, and start a new one
+  new->numChangedCells = snapshots->numChangedCells;
+  if (new->numChangedCells > 0){
+    memcpy(new->changedCells, snapshots->changedCells,
+                              new->numChangedCells * sizeof(int));
+  }
+  snapshots->numChangedCells = 0;
+
+  // swap it in, then move into a new epoch; the old snapshot can be reused
+  // once every reader has moved past the epoch it was replaced in
+  snapshot_t* old = atomic_exchange(&snapshots->current, new);
+  if (old != NULL){
+    old->retiredAt = atomic_fetch_add(&snapshots->epoch, 1) + 1;
+    old->next = snapshots->retired;
+    snapshots->retired = old;
+  }
+
+  snapshots->dirty = false;
+  return new->version;
+}
+
+/****************** grid_snapshotAcquire ******************
+ *
+ * see grid.h for usage and description
+ *
+ */
+grid_t*
+grid_snapshotAcquire(grid_t* grid, int* pReader)
+{
+  if (grid == NULL || grid->snapshots == NULL || pReader == NULL){
+    return NULL;
+  }
+
+  snapshots_t* snapshots = grid->snapshots;
+
+  // claim a free reader slot, recording the epoch we are reading in
+  while (true){
+    unsigned long epoch = atomic_load(&snapshots->epoch);
+    for (int r = 0; r < maxSnapshotReaders; ++r){
+      unsigned long expected = 0;
+      if (atomic_compare_exchange_strong(&snapshots->readers[r], &expected,
+                                                                 epoch)){
+        *pReader = r;
+        snapshot_t* current = atomic_load(&snapshots->current);
+        return current == NULL ? NULL : &current->grid;
+      }
+    }
+    // every slot is taken; let another reader finish
+    sched_yield();
+  }
+}
+
+/****************** grid_snapshotRelease ******************
+ *
+ * see grid.h for usage and description
+ *
+ */
+void
+grid_snapshotRelease(grid_t* grid, const int reader)
+{
+  if (grid == NULL || grid->snapshots == NULL || reader < 0
+                                               || reader >= maxSnapshotReaders){
+    return;
+  }
+
+  atomic_store(&grid->snapshots->readers[reader], 0);
+}
+
+/****************** grid_changedCells *********************
+ *
+ * see grid.h for usage and description
+ *
+ */
+const int*
+grid_changedCells(grid_t* snapshot, int* pNumCells)
+{
+  if (pNumCells != NULL){
+    *pNumCells = 0;
+  }
+
+  if (snapshot == NULL || snapshot->snapshots != NULL || snapshot->base == NULL
+                       || pNumCells == NULL){
+    return NULL;
+  }
+
+  snapshot_t* snap = (snapshot_t*) snapshot;
+  if (snap->numChangedCells < 0){
+    return NULL;
+  }
+
+  *pNumCells = snap->numChangedCells;
+  return snap->changedCells;
+}
+
+/****************** grid_snapshotVersion ******************
+ *
+ * see grid.h for usage and description
+ *
+ */
+unsigned long
+grid_snapshotVersion(grid_t* snapshot)
+{
+  if (snapshot == NULL || snapshot->snapshots != NULL || snapshot->base == NULL){
+    return 0;
+  }
+
+  // snapshots are only ever handed out as the first member of a snapshot_t
+  return ((snapshot_t*) snapshot)->version;
 }
 
 
@@ -714,6 +1459,33 @@ indexOf(const int x, const int y, const int numcols)
   return (numcols + 1) * y + x;
 }
 
+/****************** tileOf ********************************
+ *
+ * gives the tile that the (x,y) coordinate falls in; tiles are
+ * numbered row by row
+ *
+ * does NO checking for whether the arguments are valid
+ *
+ */
+static inline int
+tileOf(const int x, const int y, const int numcols)
+{
+  int tilesPerRow = (numcols + tileSize - 1) / tileSize;
+  return (y / tileSize) * tilesPerRow + x / tileSize;
+}
+
+/****************** numTiles ******************************
+ *
+ * gives the number of tiles a grid of this size is divided into
+ *
+ */
+static inline int
+numTiles(const int numrows, const int numcols)
+{
+  return ((numrows + tileSize - 1) / tileSize)
+       * ((numcols + tileSize - 1) / tileSize);
+}
+
 /****************** getCoordsFromIndex ********************
  *
  * gets the coordinates of a point from its index
@@ -774,11 +1546,12 @@ isVisible(grid_t* grid, const int px, const int py, const int x, const int y)
 /****************** isBlockedHorizontally *****************
  *
  * Does the visibility check for all the x-values between
- * px and x (both exclusive)
+ * px and x (px inclusive, x exclusive)
  *
- * Finds the intersection points of the line joining (px, py) and (x,y),
- * (avoiding floating point math), and checks 
- * whether they are blocked
+ * Follows the line joining (px, py) and (x,y) a column at a time,
+ * keeping the row it crosses each column at as a whole part (rounded
+ * towards py) and a remainder, so no division is needed; checks
+ * whether each crossing is blocked
  */
 static bool
 isBlockedHorizontally(grid_t* grid, const int px, const int py, const int x,
@@ -788,26 +1561,40 @@ isBlockedHorizontally(grid_t* grid, const int px, const int py, const int x,
     return false;
   }
 
-  int sign = px < x ? 1 : -1;
-  int slopeNumerator = py - y;
-  int slopeDenominator = px - x;
-
-  for (int xi = px; xi != x; xi += sign){
-    int delta = xi - px;
-    int numerator = slopeNumerator * delta;
-    bool isGridpoint = numerator % slopeDenominator == 0;
-    int yi = numerator / slopeDenominator + py;
-    if (isGridpoint){
-      if (isBlocking(grid, xi, yi)){
+  // the line rises |y - py| rows over |x - px| columns
+  int run = abs(x - px);
+  int rise = abs(y - py);
+  int stepX = px < x ? 1 : -1;
+  int stepY = py < y ? 1 : -1;
+  int wholeStep = rise / run;
+  int partStep = rise % run;
+
+  // both ends are on the map, and every crossing lies between them,
+  // so the string can be read directly
+  const char* string = grid->string;
+  int rowLength = grid->numcols + 1;
+  int whole = 0;
+  int part = 0;
+  for (int xi = px; xi != x; xi += stepX){
+    int index = indexOf(xi, py + stepY * whole, grid->numcols);
+    if (part == 0){
+      // a gridpoint
+      if (blocksSight(string[index])){
         return true;
       }
     } else {
-      // if not gridpoint, then integer division will return the 
-      // floor of the actual value
-      if (isBlocking(grid, xi, yi) && isBlocking(grid, xi, yi + 1)){
+      // between two rows; the line is blocked only if both are
+      if (blocksSight(string[index]) && blocksSight(string[index + rowLength])){
         return true;
       }
     }
+
+    whole += wholeStep;
+    part += partStep;
+    if (part >= run){
+      part -= run;
+      ++whole;
+    }
   }
 
   return false;
@@ -816,11 +1603,10 @@ isBlockedHorizontally(grid_t* grid, const int px, const int py, const int x,
 /****************** isBlockedVertically *******************
  *
  * Does the visibility check for all the y-values between
- * py and y (both exclusive)
+ * py and y (py inclusive, y exclusive)
  *
- * Finds the intersection points of the line joining (px, py) and (x,y),
- * (avoiding floating point math), and checks 
- * whether they are blocked
+ * Follows the line joining (px, py) and (x,y) a row at a time,
+ * the same way isBlockedHorizontally follows it a column at a time
  */
 static bool
 isBlockedVertically(grid_t* grid, const int px, const int py, const int x,
@@ -830,45 +1616,50 @@ isBlockedVertically(grid_t* grid, const int px, const int py, const int x,
     return false;
   }
 
-  int sign = py < y ? 1 : -1;
-  int slopeNumerator = px - x;
-  int slopeDenominator = py - y;
-
-  for (int yi = py; yi != y; yi += sign){
-    int delta = yi - py;
-    int numerator = slopeNumerator * delta;
-    bool isGridpoint = numerator % slopeDenominator == 0;
-    int xi = numerator / slopeDenominator + px;
-    if (isGridpoint){
-      if (isBlocking(grid, xi, yi)){
+  // the line moves |x - px| columns over |y - py| rows
+  int run = abs(y - py);
+  int rise = abs(x - px);
+  int stepX = px < x ? 1 : -1;
+  int stepY = py < y ? 1 : -1;
+  int wholeStep = rise / run;
+  int partStep = rise % run;
+
+  const char* string = grid->string;
+  int whole = 0;
+  int part = 0;
+  for (int yi = py; yi != y; yi += stepY){
+    int index = indexOf(px + stepX * whole, yi, grid->numcols);
+    if (part == 0){
+      // a gridpoint
+      if (blocksSight(string[index])){
         return true;
       }
     } else {
-      // if not gridpoint, then integer division will return the 
-      // floor of the actual value
-      if (isBlocking(grid, xi, yi) && isBlocking(grid, xi + 1, yi)){
+      // between two columns; the line is blocked only if both are
+      if (blocksSight(string[index]) && blocksSight(string[index + 1])){
         return true;
       }
     }
+
+    whole += wholeStep;
+    part += partStep;
+    if (part >= run){
+      part -= run;
+      ++whole;
+    }
   }
 
   return false;
 }
 
-/****************** isBlocking ****************************
+/****************** blocksSight ***************************
  *
- * returns whether the character at a given location blocks
- * line-of-sight
+ * returns whether a map character blocks vision
  *
  */
 static bool
-isBlocking(grid_t* grid, const int x, const int y)
+blocksSight(const char toCheck)
 {
-  char toCheck = grid_charAt(grid, x, y);
-  if (toCheck == '\0'){
-    return true;
-  }
-  
   // players and gold do not block vision
   return toCheck == mapchars_solidRock
       || toCheck == mapchars_horizontalBoundary
@@ -886,70 +1677,545 @@ isBlocking(grid_t* grid, const int x, const int y)
 static char
 getPlayerStandingOn(grid_t* grid, const char playerChar)
 {
-  if (grid == NULL){
+  if (grid == NULL || grid->playersStandingOn == NULL){
     return mapchars_roomSpot;
   }
 
-  char* charString = calloc(2, sizeof(char));
-  mem_assert(charString, "out of memory\n");
+  return grid->playersStandingOn[(unsigned char) playerChar];
+}
+
+/****************** setPlayerStandingOn *******************
+ *
+ * updates the grid's bookkeeping of what the player is standing on
+ *
+ */
+static void
+setPlayerStandingOn(grid_t* grid, const char playerChar, const char newChar)
+{
+  if (grid == NULL || grid->playersStandingOn == NULL){
+    return;
+  }
+
+  grid->playersStandingOn[(unsigned char) playerChar] = newChar;
+}
 
-  charString[0] = playerChar;
-  charString[1] = '\0';
+/****************** markChanged ***************************
+ *
+ * records that a cell of the master grid has changed since
+ * the last snapshot, given what it held before
+ *
+ */
+static void
+markChanged(grid_t* grid, const int index, const char oldChar)
+{
+  snapshots_t* snapshots = grid->snapshots;
+  if (snapshots == NULL){
+    return;
+  }
 
-  char* pResult = hashtable_find(grid->playersStandingOn, charString);
-  free(charString);
+  snapshots->dirty = true;
 
-  if (pResult == NULL){
-    return mapchars_roomSpot;
+  // a player standing in a passage does not block vision, but the empty
+  // passage does; when that changes, what everyone can see may change too,
+  // so listing the cell alone is not enough
+  if (blocksSight(oldChar) != blocksSight(grid->string[index])){
+    snapshots->numChangedCells = -1;
+    return;
   }
 
-  return *pResult;
+  // once the list overflows, the next snapshot just says "everything"
+  if (snapshots->numChangedCells < 0){
+    return;
+  }
+  for (int i = 0; i < snapshots->numChangedCells; ++i){
+    if (snapshots->changedCells[i] == index){
+      return;
+    }
+  }
+  if (snapshots->numChangedCells == maxChangedCells){
+    snapshots->numChangedCells = -1;
+    return;
+  }
+  snapshots->changedCells[snapshots->numChangedCells++] = index;
 }
 
-/****************** setPlayerStandingOn *******************
+/****************** testBit *******************************
  *
- * updates the grid's bookkeeping of what the player is standing on
+ * returns whether bit index of a bitset is set
+ *
+ */
+static inline bool
+testBit(const unsigned long* bits, const int index)
+{
+  return (bits[index / bitsPerWord] >> (index % bitsPerWord)) & 1;
+}
+
+/****************** countBits *****************************
+ *
+ * returns the number of bits set in a word
+ *
+ */
+static inline int
+countBits(const unsigned long word)
+{
+  return __builtin_popcountl(word);
+}
+
+/****************** displayCharAt *************************
+ *
+ * the character at a string index of what visibleGrid shows,
+ * given what is on grid now; visibleGrid may also be a grid with
+ * a string of its own (such as grid itself), shown as it is
+ *
+ */
+static inline char
+displayCharAt(grid_t* grid, grid_t* visibleGrid, const int index)
+{
+  if (visibleGrid->string != NULL){
+    return visibleGrid->string[index];
+  }
+
+  if (index == visibleGrid->selfIndex){
+    return mapchars_player;
+  }
+
+  // a cell out of view shows only its terrain, if it has ever been seen
+  if (testBit(visibleGrid->visible, index)){
+    return grid->string[index];
+  }
+  if (testBit(visibleGrid->seen, index)){
+    return grid->base[index];
+  }
+
+  return mapchars_solidRock;
+}
+
+/****************** blendScalar ***************************
+ *
+ * writes n (at most a word of) cells of a player's display: the current
+ * character where the visible bit is set, else the base character where
+ * the seen bit is set, else solid rock
  *
  */
 static void
-setPlayerStandingOn(grid_t* grid, const char playerChar, const char newChar)
+blendScalar(char* out, const char* current, const char* base,
+            const unsigned long visible, const unsigned long seen, const int n)
 {
-  if (grid == NULL){
-    return;
+  for (int i = 0; i < n; ++i){
+    char shown = (seen >> i) & 1 ? base[i] : mapchars_solidRock;
+    out[i] = (visible >> i) & 1 ? current[i] : shown;
+  }
+}
+
+#ifdef GRID_X86
+/****************** blendSSE2 *****************************
+ *
+ * blendScalar, 16 cells at a time; each 16 bits of a mask are spread
+ * out into 16 bytes of all ones or all zeros, and the bytes picked
+ * with and/andnot/or
+ *
+ */
+__attribute__((target("sse2")))
+static void
+blendSSE2(char* out, const char* current, const char* base,
+          const unsigned long visible, const unsigned long seen, const int n)
+{
+  // byte i of each half tests bit i of the corresponding mask byte
+  const __m128i bit = _mm_set1_epi64x(0x8040201008040201LL);
+  const __m128i rock = _mm_set1_epi8(mapchars_solidRock);
+
+  int i = 0;
+  for (; i + 16 <= n; i += 16){
+    // [lo, hi, ...] -> [lo x 8, hi x 8], then compare against the bits
+    __m128i v = _mm_cvtsi32_si128((int) ((visible >> i) & 0xFFFF));
+    __m128i s = _mm_cvtsi32_si128((int) ((seen >> i) & 0xFFFF));
+    v = _mm_unpacklo_epi8(v, v);
+    s = _mm_unpacklo_epi8(s, s);
+    v = _mm_unpacklo_epi16(v, v);
+    s = _mm_unpacklo_epi16(s, s);
+    v = _mm_unpacklo_epi32(v, v);
+    s = _mm_unpacklo_epi32(s, s);
+    v = _mm_cmpeq_epi8(_mm_and_si128(v, bit), bit);
+    s = _mm_cmpeq_epi8(_mm_and_si128(s, bit), bit);
+
+    __m128i c = _mm_loadu_si128((const __m128i*) (current + i));
+    __m128i b = _mm_loadu_si128((const __m128i*) (base + i));
+    __m128i shown = _mm_or_si128(_mm_and_si128(s, b), _mm_andnot_si128(s, rock));
+    __m128i result = _mm_or_si128(_mm_and_si128(v, c), _mm_andnot_si128(v, shown));
+    _mm_storeu_si128((__m128i*) (out + i), result);
+  }
+
+  // whatever is left of a short last word
+  if (i < n){
+    blendScalar(out + i, current + i, base + i, visible >> i, seen >> i, n - i);
+  }
+}
+
+/****************** blendAVX2 *****************************
+ *
+ * blendScalar, 32 cells at a time; as blendSSE2, but the mask bytes
+ * are spread out with a byte shuffle, and picked with blendv
+ *
+ */
+__attribute__((target("avx2")))
+static void
+blendAVX2(char* out, const char* current, const char* base,
+          const unsigned long visible, const unsigned long seen, const int n)
+{
+  // byte i of the result takes byte i / 8 of the 32 mask bits; the shuffle
+  // works within each 128-bit half, so the upper half indexes bytes 2 and 3
+  const __m256i spread = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0,
+                                          1, 1, 1, 1, 1, 1, 1, 1,
+                                          2, 2, 2, 2, 2, 2, 2, 2,
+                                          3, 3, 3, 3, 3, 3, 3, 3);
+  const __m256i bit = _mm256_set1_epi64x(0x8040201008040201LL);
+  const __m256i rock = _mm256_set1_epi8(mapchars_solidRock);
+
+  int i = 0;
+  for (; i + 32 <= n; i += 32){
+    __m256i v = _mm256_set1_epi32((int) ((visible >> i) & 0xFFFFFFFFUL));
+    __m256i s = _mm256_set1_epi32((int) ((seen >> i) & 0xFFFFFFFFUL));
+    v = _mm256_shuffle_epi8(v, spread);
+    s = _mm256_shuffle_epi8(s, spread);
+    v = _mm256_cmpeq_epi8(_mm256_and_si256(v, bit), bit);
+    s = _mm256_cmpeq_epi8(_mm256_and_si256(s, bit), bit);
+
+    __m256i c = _mm256_loadu_si256((const __m256i*) (current + i));
+    __m256i b = _mm256_loadu_si256((const __m256i*) (base + i));
+    __m256i shown = _mm256_blendv_epi8(rock, b, s);
+    _mm256_storeu_si256((__m256i*) (out + i), _mm256_blendv_epi8(shown, c, v));
+  }
+
+  // a short last word is finished 16 cells, then one cell, at a time
+  if (i < n){
+    blendSSE2(out + i, current + i, base + i, visible >> i, seen >> i, n - i);
+  }
+}
+#endif
+
+/****************** findRegions ***************************
+ *
+ * labels the rooms and passages of a map, given its terrain,
+ * and works out which rooms are rectangles and where their
+ * doors are
+ *
+ */
+static regions_t*
+findRegions(const char* base, const int numrows, const int numcols)
+{
+  int length = numrows * (numcols + 1);
+  regions_t* regions = malloc(sizeof(regions_t));
+  mem_assert(regions, "out of memory; could not index rooms\n");
+  regions->regionOf = malloc(length * sizeof(int));
+  regions->cells = malloc(length * sizeof(int));
+  mem_assert(regions->regionOf, "out of memory; could not index rooms\n");
+  mem_assert(regions->cells, "out of memory; could not index rooms\n");
+  for (int i = 0; i < length; ++i){
+    regions->regionOf[i] = -1;
+  }
+
+  // label rooms, then passages, a flood fill at a time
+  int capacity = 16;
+  region_t* list = malloc(capacity * sizeof(region_t));
+  mem_assert(list, "out of memory; could not index rooms\n");
+  int numRegions = 0;
+  int numCells = 0;
+  for (int pass = 0; pass < 2; ++pass){
+    char kind = pass == 0 ? mapchars_roomSpot : mapchars_passageSpot;
+    for (int i = 0; i < length; ++i){
+      if (base[i] != kind || regions->regionOf[i] >= 0){
+        continue;
+      }
+
+      if (numRegions == capacity){
+        capacity *= 2;
+        list = realloc(list, capacity * sizeof(region_t));
+        mem_assert(list, "out of memory; could not index rooms\n");
+      }
+      region_t* region = &list[numRegions];
+      region->isRoom = pass == 0;
+      region->isRectangle = false;      // decided below, for rooms
+      region->firstDoor = 0;
+      region->numDoors = 0;
+      region->firstCell = numCells;
+      region->numCells = fillRegion(base, numrows, numcols, i,
+                                    regions->regionOf, regions->cells + numCells,
+                                    numRegions);
+      numCells += region->numCells;
+
+      getCoordsFromIndex(i, numcols, &region->left, &region->top);
+      region->right = region->left;
+      region->bottom = region->top;
+      for (int c = 0; c < region->numCells; ++c){
+        int x, y;
+        getCoordsFromIndex(regions->cells[region->firstCell + c], numcols, &x, &y);
+        region->left = x < region->left ? x : region->left;
+        region->right = x > region->right ? x : region->right;
+        region->top = y < region->top ? y : region->top;
+        region->bottom = y > region->bottom ? y : region->bottom;
+      }
+      ++numRegions;
+    }
+
+    if (pass == 0){
+      regions->numRooms = numRegions;
+    }
   }
+  regions->list = list;
+  regions->numRegions = numRegions;
+
+  // a room is a rectangle if it fills its bounding box, and everything in
+  // the ring just outside it blocks vision; the passage spots in the ring
+  // are its doors, which stop blocking when a player stands in them
+  int numDoors = 0;
+  regions->doors = malloc(length * sizeof(int));
+  mem_assert(regions->doors, "out of memory; could not index rooms\n");
+  for (int r = 0; r < regions->numRooms; ++r){
+    region_t* room = &list[r];
+    int width = room->right - room->left + 1;
+    int height = room->bottom - room->top + 1;
+    room->isRectangle = room->numCells == width * height;
+    room->firstDoor = numDoors;
+    room->numDoors = 0;
+
+    for (int y = room->top - 1; y <= room->bottom + 1 && room->isRectangle; ++y){
+      for (int x = room->left - 1; x <= room->right + 1; ++x){
+        bool inRing = y < room->top || y > room->bottom
+                   || x < room->left || x > room->right;
+        if (!inRing || !isValidCoordinate(x, y, numrows, numcols)){
+          continue;     // off the map blocks vision too
+        }
+
+        int index = indexOf(x, y, numcols);
+        if (!blocksSight(base[index])){
+          room->isRectangle = false;
+          break;
+        }
+        if (base[index] == mapchars_passageSpot){
+          regions->doors[numDoors++] = index;
+          ++room->numDoors;
+        }
+      }
+    }
 
-  char* charString = calloc(2, sizeof(char));
-  mem_assert(charString, "out of memory\n");
-  charString[0] = playerChar;
-  charString[1] = '\0';
+    if (!room->isRectangle){
+      numDoors = room->firstDoor;
+      room->numDoors = 0;
+    }
+  }
 
-  // We can't insert a char; we need to insert a pointer to one
-  // We can't just use the memory location of new char as that's on the stack
+  return regions;
+}
 
-  hashtable_t* ht = grid->playersStandingOn;
-  char* pChar = hashtable_find(ht, charString);
-  if (pChar == NULL){
-  pChar = malloc(sizeof(char));
-  mem_assert(pChar, "out of memory\n");
-  hashtable_insert(ht, charString, pChar);
-  } 
+/****************** fillRegion ****************************
+ *
+ * labels every cell of the same kind as base[start] joined to it
+ * with id, listing them in cells (which is also the work queue);
+ * returns how many there are
+ *
+ */
+static int
+fillRegion(const char* base, const int numrows, const int numcols,
+           const int start, int* regionOf, int* cells, const int id)
+{
+  char kind = base[start];
+  regionOf[start] = id;
+  cells[0] = start;
+
+  int numCells = 1;
+  for (int next = 0; next < numCells; ++next){
+    int x, y;
+    getCoordsFromIndex(cells[next], numcols, &x, &y);
+    for (int dy = -1; dy <= 1; ++dy){
+      for (int dx = -1; dx <= 1; ++dx){
+        if (!isValidCoordinate(x + dx, y + dy, numrows, numcols)){
+          continue;
+        }
+        int index = indexOf(x + dx, y + dy, numcols);
+        if (base[index] == kind && regionOf[index] < 0){
+          regionOf[index] = id;
+          cells[numCells++] = index;
+        }
+      }
+    }
+  }
 
-  *pChar = newChar;
-  free(charString); // the key got copied
+  return numCells;
 }
 
-/****************** freeCharItemdelete ********************
+/****************** rectangleAt ***************************
  *
- * itemdelete for the standingOn hashtable
- * we cannot simply pass in 'free' because we need to deal with the null case
+ * returns the rectangular room that (x, y) is in, and says whether
+ * any of its doors has a player in it; NULL if (x, y) is not in a
+ * rectangular room, or the room index is not in use
+ *
+ */
+static region_t*
+rectangleAt(grid_t* grid, const int x, const int y, bool* pDoorsOpen)
+{
+  regions_t* regions = grid->regions;
+  if (!useRoomIndex || regions == NULL){
+    return NULL;
+  }
+
+  int r = regions->regionOf[indexOf(x, y, grid->numcols)];
+  if (r < 0 || !regions->list[r].isRectangle){
+    return NULL;
+  }
+
+  region_t* room = &regions->list[r];
+  *pDoorsOpen = false;
+  for (int d = 0; d < room->numDoors; ++d){
+    if (!blocksSight(grid->string[regions->doors[room->firstDoor + d]])){
+      *pDoorsOpen = true;
+    }
+  }
+
+  return room;
+}
+
+/****************** summarizeTiles ************************
+ *
+ * works out, for every tile of a map given its terrain, whether it
+ * holds only solid rock, only room spots, or a mix
+ *
+ */
+static char*
+summarizeTiles(const char* base, const int numrows, const int numcols)
+{
+  int tilesPerRow = (numcols + tileSize - 1) / tileSize;
+  char* kinds = malloc(numTiles(numrows, numcols) * sizeof(char));
+  mem_assert(kinds, "out of memory; could not summarize tiles\n");
+
+  for (int tile = 0; tile < numTiles(numrows, numcols); ++tile){
+    int left = (tile % tilesPerRow) * tileSize;
+    int top = (tile / tilesPerRow) * tileSize;
+    bool allRock = true;
+    bool allRoom = true;
+    for (int y = top; y < top + tileSize && y < numrows; ++y){
+      for (int x = left; x < left + tileSize && x < numcols; ++x){
+        char terrain = base[indexOf(x, y, numcols)];
+        allRock = allRock && terrain == mapchars_solidRock;
+        allRoom = allRoom && terrain == mapchars_roomSpot;
+      }
+    }
+    kinds[tile] = allRock ? rockTile : allRoom ? openTile : mixedTile;
+  }
+
+  return kinds;
+}
+
+/****************** tileView ******************************
+ *
+ * says how much of a tile a player at (px, py) can see, without
+ * tracing rays: none of a tile of solid rock, of one outside the
+ * room the player is in when its doors are shut, or of one beyond the
+ * sight radius; all of an open tile
+ * the player is in, since a line between two of its cells only
+ * crosses room spots; otherwise some, so each cell must be tested
+ *
+ */
+static int
+tileView(grid_t* grid, const int tileX, const int tileY, const int px,
+         const int py, region_t* room, const bool doorsOpen)
+{
+  if (!useTileCulling || grid->tileKinds == NULL){
+    return seesSome;
+  }
+
+  int tilesPerRow = (grid->numcols + tileSize - 1) / tileSize;
+  char kind = grid->tileKinds[tileY * tilesPerRow + tileX];
+  if (kind == rockTile){
+    return seesNone;
+  }
+
+  int left = tileX * tileSize;
+  int top = tileY * tileSize;
+  int right = left + tileSize - 1;
+  int bottom = top + tileSize - 1;
+  if (room != NULL && !doorsOpen
+      && (right < room->left - 1 || left > room->right + 1
+          || bottom < room->top - 1 || top > room->bottom + 1)){
+    return seesNone;
+  }
+
+  // the cell of the tile nearest the player may be out of sight
+  int nearestX = px < left ? left : px > right ? right : px;
+  int nearestY = py < top ? top : py > bottom ? bottom : py;
+  if (!isWithinSight(grid, px, py, nearestX, nearestY)){
+    return seesNone;
+  }
+
+  if (kind == openTile && px >= left && px <= right
+                       && py >= top && py <= bottom){
+    return seesAll;
+  }
+
+  return seesSome;
+}
+
+/****************** isWithinSight *************************
+ *
+ * returns whether (x, y) is close enough to (px, py) to be seen,
+ * given the grid's sight radius
+ *
+ */
+static inline bool
+isWithinSight(grid_t* grid, const int px, const int py, const int x,
+                                                        const int y)
+{
+  int radius = grid->sightRadius;
+  return radius <= 0
+      || (x - px) * (x - px) + (y - py) * (y - py) <= radius * radius;
+}
+
+/****************** reclaimSnapshots **********************
+ *
+ * moves every retired snapshot that no reader can still be
+ * looking at onto the free list
  *
  */
 static void
-freeCharItemdelete(void* pChar)
+reclaimSnapshots(snapshots_t* snapshots)
 {
-  if (pChar == NULL){
+  if (snapshots->retired == NULL){
     return;
   }
 
-  free(pChar);
+  // the oldest epoch any active reader is still in
+  unsigned long oldest = atomic_load(&snapshots->epoch);
+  for (int r = 0; r < maxSnapshotReaders; ++r){
+    unsigned long epoch = atomic_load(&snapshots->readers[r]);
+    if (epoch != 0 && epoch < oldest){
+      oldest = epoch;
+    }
+  }
+
+  snapshot_t** pPrev = &snapshots->retired;
+  while (*pPrev != NULL){
+    snapshot_t* curr = *pPrev;
+    if (curr->retiredAt <= oldest){
+      *pPrev = curr->next;
+      curr->next = snapshots->free;
+      snapshots->free = curr;
+    } else {
+      pPrev = &curr->next;
+    }
+  }
+}
+
+/****************** freeSnapshotList **********************
+ *
+ * frees a list of snapshots (but not the base they share)
+ *
+ */
+static void
+freeSnapshotList(snapshot_t* list)
+{
+  while (list != NULL){
+    snapshot_t* next = list->next;
+    free(list->grid.string);
+    free(list);
+    list = next;
+  }
 }
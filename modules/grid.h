@@ -151,8 +151,8 @@ bool grid_nuggetsPopulate(grid_t* grid, const int minNumPiles, const int maxNumP
  * Generates the grid visible to a given player
  *
  * Caller provides:
- *  valid pointer to a grid
- *  valid pointer to a 'valid' player - player is in the game, at valid 
+ *  valid pointer to a grid; either the master grid or a snapshot of it
+ *  valid pointer to a 'valid' player - player is in the game, at valid
  *  coordinates, etc.
  * We return:
  *  A pointer to the grid visible to the player
@@ -166,17 +166,148 @@ bool grid_nuggetsPopulate(grid_t* grid, const int minNumPiles, const int maxNumP
  *  NONE of the other grid function in this module should be called on the grid
  *  returned by this, as this grid is for display purposes only
  *
- *  Only the following functions are defined on this grid:
- *  - getDisplay
- *  - toMap
- *  - charAt
- * 
+ *  The grid does not hold a copy of the map; it only records, a bit per
+ *  cell, which cells the player can see now and which they have ever seen.
+ *  What it displays depends on what is on the master grid (or snapshot)
+ *  at the time, so the display is composed on demand by:
+ *  - composeView
+ *  - viewHash
+ *  - viewEquals
+ *  It also works with seesTile and numChanged.
+ *
+ *  Solid rock is never counted as in view; it looks the same whether seen
+ *  or not, and nothing ever moves onto it.
  *
  */
 grid_t* grid_generateVisibleGrid(grid_t* grid, grid_t* currentlyVisibleGrid,
                                                const int px,
                                                const int py);
 
+/****************** grid_refreshVisibleGrid ***************
+ *
+ * Brings some cells of a player's visible grid up to date, for a player
+ * who has not moved since it was last generated
+ *
+ * Caller provides:
+ *  valid pointer to a grid; either the master grid or a snapshot of it
+ *  a grid returned by grid_generateVisibleGrid for a player at (px, py),
+ *  and the player's coordinates, which must be the same as they were then
+ *  an array of string indices of the cells that may have changed, and its
+ *  length (e.g. from grid_changedCells)
+ * We do:
+ *  Work out which of those cells the player can see, so that
+ *  grid_numChanged says whether the display may have changed
+ * We return:
+ *  true on success, false on error
+ * Notes:
+ *  As long as nothing has changed what blocks vision, a player who has not
+ *  moved can see exactly the same cells as before; only what is on them
+ *  may differ. grid_changedCells says when that does not hold.
+ *  Afterwards grid_numChanged gives the number of cells this call changed.
+ */
+bool grid_refreshVisibleGrid(grid_t* grid, grid_t* visibleGrid, const int px,
+                             const int py, const int* cells, const int numCells);
+
+/****************** grid_setSightRadius *******************
+ *
+ * Limits how far players can see, e.g. to bound the work of each move
+ * on a very large map
+ *
+ * Caller provides:
+ *  valid pointer to the master grid
+ *  the radius, in cells; 0 (the default) for no limit
+ * We do:
+ *  Make grid_generateVisibleGrid, on the grid and on snapshots published
+ *  from now on, only count cells within that distance of the player as
+ *  in view
+ * Notes:
+ *  Cells seen earlier are still remembered once out of sight. The work of
+ *  each visibility update then depends on the radius, not the map size.
+ */
+void grid_setSightRadius(grid_t* grid, const int radius);
+
+/****************** grid_useRoomIndex *********************
+ *
+ * chooses whether grid_generateVisibleGrid may use the rooms found by
+ * grid_fromMap, e.g. to check it against ray tests alone
+ *
+ * Caller provides:
+ *  true to use the room index, which is the default; false to test every
+ *  cell with a ray
+ * Notes:
+ *  Both ways give exactly the same visible grid. For a player in a
+ *  rectangular room, everything up to and including its walls is in view,
+ *  and nothing beyond unless a player stands in one of its doorways; rays
+ *  are only needed then. Call this before the grid module is used from
+ *  more than one thread.
+ */
+void grid_useRoomIndex(const bool wanted);
+
+/****************** grid_useTileCulling *******************
+ *
+ * chooses whether grid_generateVisibleGrid may pass over whole tiles
+ * that cannot be seen, e.g. to check it against testing every cell
+ *
+ * Caller provides:
+ *  true to cull tiles, which is the default; false to look at each cell
+ * Notes:
+ *  Both ways give exactly the same visible grid. grid_fromMap sorts the
+ *  tiles into solid rock, open room and a mix of terrain; tiles of solid
+ *  rock, and tiles beyond the walls of a rectangular room whose doorways
+ *  are empty, cannot be seen from inside it. Call this before the grid
+ *  module is used from more than one thread.
+ */
+void grid_useTileCulling(const bool wanted);
+
+/****************** grid_numTiles *************************
+ *
+ * The grid is divided into small square tiles, so callers can keep track
+ * of who can see what by area instead of by cell
+ *
+ * Caller provides:
+ *  valid pointer to a grid
+ * We return:
+ *  the number of tiles; tiles are numbered from 0
+ *  0 if error
+ */
+int grid_numTiles(grid_t* grid);
+
+/****************** grid_tileOfCell ***********************
+ *
+ * Caller provides:
+ *  valid pointer to a grid
+ *  the string index of a cell, as returned by grid_changedCells
+ * We return:
+ *  the tile the cell is in
+ *  -1 if error
+ */
+int grid_tileOfCell(grid_t* grid, const int index);
+
+/****************** grid_seesTile *************************
+ *
+ * Caller provides:
+ *  a grid returned by grid_generateVisibleGrid
+ *  a tile number
+ * We return:
+ *  true if the player could see at least one cell of the tile when the
+ *  grid was last generated
+ *  false otherwise, or on error
+ */
+bool grid_seesTile(grid_t* visibleGrid, const int tile);
+
+/****************** grid_numChanged ***********************
+ *
+ * Caller provides:
+ *  a grid returned by grid_generateVisibleGrid
+ * We return:
+ *  an upper bound on the number of cells whose display the last
+ *  grid_generateVisibleGrid or grid_refreshVisibleGrid call on it may
+ *  have changed: every cell in view, or just out of view, after a
+ *  generate; the given cells in view after a refresh
+ *  0 if error, or if the display is certainly the same as before
+ */
+int grid_numChanged(grid_t* visibleGrid);
+
 /****************** grid_findRandomSpawnPosition **********
  *
  * finds a random spot where a player can be added
@@ -289,11 +420,97 @@ int grid_collectGold(grid_t* grid, const int px, const int py);
  *  valid pointer to a grid
  * We return:
  *  a copy of the grid string within the grid
+ *  NULL if error, or if the grid has no string (see grid_composeView)
  * Caller is responsible for:
  *  freeing the returned string.
  */
 char* grid_getDisplay(grid_t* grid);
 
+/****************** grid_displayLength ********************
+ *
+ * Caller provides:
+ *  valid pointer to a grid
+ * We return:
+ *  the length of the display string, not counting the null character
+ *  0 if error
+ */
+int grid_displayLength(grid_t* grid);
+
+/****************** grid_viewHash *************************
+ *
+ * Caller provides:
+ *  valid pointer to a grid; the master grid or a snapshot of it
+ *  a grid returned by grid_generateVisibleGrid, or a grid with a string
+ *  of its own (such as the first grid itself)
+ * We return:
+ *  a 64-bit (FNV-1a) hash of what grid_composeView would return; the
+ *  same display always has the same hash
+ *  0 if error
+ */
+unsigned long grid_viewHash(grid_t* grid, grid_t* visibleGrid);
+
+/****************** grid_viewEquals ***********************
+ *
+ * Caller provides:
+ *  valid pointer to a grid; the master grid or a snapshot of it
+ *  two grids, each as for grid_viewHash
+ * We return:
+ *  true if both would display exactly the same string
+ *  false otherwise, or if error
+ */
+bool grid_viewEquals(grid_t* grid, grid_t* a, grid_t* b);
+
+/****************** grid_composeView **********************
+ *
+ * works out the display of a visible grid, given what is on the grid
+ *
+ * Caller provides:
+ *  valid pointer to a grid; the master grid or a snapshot of it
+ *  a grid as for grid_viewHash
+ *  a buffer of at least grid_displayLength(grid) + 1 chars
+ * We return:
+ *  the display string, null terminated: the buffer, filled in, for a grid
+ *  returned by grid_generateVisibleGrid, or the string of a grid that has
+ *  one, without copying it
+ *  NULL if error
+ * Notes:
+ *  The player sees the cells in view as they are on the grid, the cells
+ *  they have seen before as bare terrain, and everything else as solid rock.
+ */
+const char* grid_composeView(grid_t* grid, grid_t* visibleGrid, char* buffer);
+
+/****************** grid_useSimd **************************
+ *
+ * chooses how grid_composeView blends the cells of a display, e.g. to
+ * compare the two in a benchmark
+ *
+ * Caller provides:
+ *  true to use vector instructions (AVX2 or SSE2) when the machine has
+ *  them, which is the default; false for plain C
+ * We return:
+ *  true if grid_composeView will now use vector instructions
+ * Notes:
+ *  Both ways give exactly the same display. Call this before the grid
+ *  module is used from more than one thread.
+ */
+bool grid_useSimd(const bool wanted);
+
+/****************** grid_displayView *********************
+ *
+ * gives read-only access to the grid string, without copying it
+ *
+ * Caller provides:
+ *  valid pointer to a grid
+ * We return:
+ *  the grid string, the same as grid_getDisplay would copy, null terminated
+ *  NULL if error, or if the grid has no string (see grid_composeView)
+ * Notes:
+ *  The string belongs to the grid; it must not be modified or freed, and it
+ *  changes whenever the grid does. For a snapshot it stays the same for as
+ *  long as the snapshot is held.
+ */
+const char* grid_displayView(grid_t* grid);
+
 /****************** grid_toMap ****************************
  *
  * prints the grid string to a file
@@ -306,5 +523,85 @@ char* grid_getDisplay(grid_t* grid);
  */
 void grid_toMap(grid_t* grid, FILE* fp);
 
+/****************** grid_publish **************************
+ *
+ * publishes a snapshot of the master grid for concurrent readers
+ *
+ * Caller provides:
+ *  valid pointer to a master grid (one made by grid_fromMap)
+ * We do:
+ *  if the grid has changed since the last publish, copy its current
+ *  state into a new immutable snapshot and make that the one handed out by
+ *  grid_snapshotAcquire. Snapshots that readers have finished with are
+ *  recycled rather than freed.
+ * We return:
+ *  the version number of the current snapshot (1 for the first publish)
+ *  0 on error
+ * Notes:
+ *  Only one thread may modify and publish the master grid. Readers never
+ *  block the publisher and the publisher never blocks readers.
+ */
+unsigned long grid_publish(grid_t* grid);
+
+/****************** grid_snapshotAcquire ******************
+ *
+ * starts reading the most recently published snapshot
+ *
+ * Caller provides:
+ *  valid pointer to a master grid
+ *  valid pointer to an int, which we fill in with a reader id
+ * We return:
+ *  the current snapshot, as a read-only grid
+ *  NULL if error or if nothing has been published yet; the caller must
+ *  still call grid_snapshotRelease in that case
+ * Caller is responsible for:
+ *  calling grid_snapshotRelease with the same reader id when done, and
+ *  not using the snapshot after that
+ * Notes:
+ *  Any number of threads may read at once. The snapshot never changes while
+ *  it is held, even if the master grid is modified and published again.
+ *  Only the read-only functions may be called on a snapshot:
+ *  numrows, numcols, charAt, baseCharAt, getDisplay, toMap, and being the
+ *  source grid of generateVisibleGrid.
+ */
+grid_t* grid_snapshotAcquire(grid_t* grid, int* pReader);
+
+/****************** grid_snapshotRelease ******************
+ *
+ * finishes reading a snapshot
+ *
+ * Caller provides:
+ *  valid pointer to the master grid, and the reader id from
+ *  grid_snapshotAcquire
+ */
+void grid_snapshotRelease(grid_t* grid, const int reader);
+
+/****************** grid_snapshotVersion ******************
+ *
+ * Caller provides:
+ *  a snapshot returned by grid_snapshotAcquire
+ * We return:
+ *  the version number of that snapshot
+ *  0 if it is not a snapshot
+ */
+unsigned long grid_snapshotVersion(grid_t* snapshot);
+
+/****************** grid_changedCells *********************
+ *
+ * Caller provides:
+ *  a snapshot returned by grid_snapshotAcquire
+ *  valid pointer to an int for the number of cells
+ * We return:
+ *  the string indices of the cells that differ between this snapshot and
+ *  the one published just before it, storing how many there are
+ *  NULL if that is not known (the first snapshot, or too many cells changed
+ *  to list), or if a change could alter which cells can be seen from where
+ *  (a player stepping into or out of a passage), in which case the caller
+ *  must assume every cell changed
+ * Notes:
+ *  The array belongs to the snapshot, and is only valid while it is held.
+ */
+const int* grid_changedCells(grid_t* snapshot, int* pNumCells);
+
 
 #endif    // __GRID_H
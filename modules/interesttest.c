@@ -0,0 +1,312 @@
+/*
+ * a file to test that every player is sent what they can see
+ *
+ * Plays a game through the game module, the way the server does, with a
+ * socket for each player to receive its messages on. After every key, the
+ * last DISPLAY each player was sent must match their view worked out
+ * afresh, from everything they have been shown, with
+ * grid_generateVisibleGrid and grid_composeView; if the
+ * game's index of who can see which tile has gone stale, a change they
+ * can see is never sent to them, and the two differ.
+ *
+ * Each game starts with a player in the passage outside a doorway, one in
+ * the doorway stepping into the room, which changes what the first can
+ * see without them moving, and a third moving about the room. Then
+ * everyone moves at random. Several games are played, with different
+ * seeds and numbers of players.
+ *
+ * Ribhu Hooja, March 2024
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "game.h"
+#include "player.h"
+#include "grid.h"
+#include "mapchars.h"
+#include "message.h"
+
+/****************** file-local global constants **********/
+static const int numGames = 50;
+static const int maxPlayers = 12;
+static const int numKeys = 1000;
+// single steps only: a long move lets the mover see along the way, which
+// a view worked out afresh where they stop would not remember
+static const char* keys = "hjklyubn";
+static const char* displayHeader = "DISPLAY\n";
+
+/****************** local types **************************/
+// what the test keeps for each player
+typedef struct client {
+  int socket;           // where the player's messages arrive
+  addr_t address;       // its address, given to the game
+  char* lastDisplay;    // the map of the last DISPLAY received
+  grid_t* visibleGrid;  // the player's view, worked out afresh every time
+} client_t;
+
+/****************** local functions **********************/
+static int playGame(const int seed, const int numPlayers);
+static bool openClient(client_t* client);
+static bool findDoorway(grid_t* grid, int* doorX, int* doorY, int* stepX,
+                        int* stepY);
+static int checkDisplays(game_t* game, client_t* clients, const int numPlayers,
+                         char* display, const int keyNumber);
+static bool pressKey(game_t* game, addr_t from, const char key);
+
+/****************** main *********************************/
+int
+main()
+{
+  // no log
+  if (message_init(NULL) == 0){
+    return 2;
+  }
+
+  int numMismatches = 0;
+  for (int i = 0; i < numGames; ++i){
+    int numPlayers = 4 + 4 * (i % 3);
+    int found = playGame(i + 1, numPlayers);
+    if (found < 0){
+      return 2;
+    }
+    if (found > 0){
+      printf("game %d, with %d players: %d stale displays\n", i + 1, numPlayers, found);
+    }
+    numMismatches += found;
+  }
+  message_done();
+
+  printf("%d games of %d keys, %d stale displays\n", numGames, numKeys, numMismatches);
+  if (numMismatches > 0){
+    printf("FAIL: a player was not sent what they can see\n");
+    return 1;
+  }
+  printf("PASS: every player was sent what they can see\n");
+  return 0;
+}
+
+/****************** playGame *****************************
+ *
+ * plays a game with the given seed and number of players, checking
+ * every display after every key; returns the number of stale displays,
+ * or -1 if the game could not be set up
+ *
+ */
+static int
+playGame(const int seed, const int numPlayers)
+{
+  srand(seed);
+
+  FILE* fp = fopen("../maps/main.txt", "r");
+  if (fp == NULL){
+    fprintf(stderr, "could not open ../maps/main.txt\n");
+    return -1;
+  }
+  game_t* game = game_init(fp, 0);
+  fclose(fp);
+  grid_t* master = game_masterGrid(game);
+
+  client_t clients[maxPlayers];
+  for (int i = 0; i < numPlayers; ++i){
+    if (!openClient(&clients[i])){
+      fprintf(stderr, "could not open a socket\n");
+      return -1;
+    }
+    clients[i].lastDisplay = calloc(grid_displayLength(master) + 1, 1);
+    clients[i].visibleGrid = NULL;
+  }
+  char* display = malloc(grid_displayLength(master) + 1);
+
+  // A in the passage outside a doorway, B in the doorway, C in the room,
+  // and the others anywhere
+  int doorX, doorY, stepX, stepY;
+  if (!findDoorway(master, &doorX, &doorY, &stepX, &stepY)){
+    fprintf(stderr, "no doorway in the map\n");
+    return -1;
+  }
+  static const int offsets[] = { -1, 0, 2 };  // steps from the doorway
+  for (int i = 0; i < numPlayers; ++i){
+    int x = 0;
+    int y = 0;
+    if (i < 3){
+      x = doorX + offsets[i] * stepX;
+      y = doorY + offsets[i] * stepY;
+    }
+    else {
+      grid_findRandomSpawnPosition(master, &x, &y);
+    }
+    player_t* player = player_new(game_getPlayers(game), clients[i].address,
+                                  x, y, "player", 'A' + i);
+    game_addPlayer(game, player);
+  }
+  int numMismatches = checkDisplays(game, clients, numPlayers, display, 0);
+
+  // B steps into the room, which changes what A can see without A moving;
+  // C moves about the room, then everyone moves about
+  game_resetScratch(game);
+  bool gameOver = game_move(game, clients[1].address, stepX, stepY);
+  numMismatches += checkDisplays(game, clients, numPlayers, display, 0);
+  for (int i = 0; i < 3 && !gameOver; ++i){
+    gameOver = pressKey(game, clients[2].address, keys[rand() % 8]);
+    if (!gameOver){
+      numMismatches += checkDisplays(game, clients, numPlayers, display, 0);
+    }
+  }
+  for (int i = 1; i <= numKeys && !gameOver; ++i){
+    char key = keys[rand() % 8];
+    gameOver = pressKey(game, clients[rand() % numPlayers].address, key);
+    if (!gameOver){
+      numMismatches += checkDisplays(game, clients, numPlayers, display, i);
+    }
+  }
+
+  if (!gameOver){
+    game_over(game);
+  }
+  for (int i = 0; i < numPlayers; ++i){
+    close(clients[i].socket);
+    free(clients[i].lastDisplay);
+    grid_delete(clients[i].visibleGrid);
+  }
+  free(display);
+  return numMismatches;
+}
+
+/****************** openClient ***************************
+ *
+ * opens a socket for a player's messages, on a port of the system's
+ * choosing, and notes its address; reading it never waits
+ *
+ */
+static bool
+openClient(client_t* client)
+{
+  client->socket = socket(AF_INET, SOCK_DGRAM, 0);
+  if (client->socket < 0){
+    return false;
+  }
+
+  memset(&client->address, 0, sizeof(client->address));
+  client->address.sin_family = AF_INET;
+  client->address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  client->address.sin_port = 0;
+  socklen_t length = sizeof(client->address);
+  return bind(client->socket, (struct sockaddr*) &client->address, length) == 0
+      && getsockname(client->socket, (struct sockaddr*) &client->address, &length) == 0
+      && fcntl(client->socket, F_SETFL, O_NONBLOCK) == 0;
+}
+
+/****************** findDoorway **************************
+ *
+ * finds a doorway: a passage spot with another passage spot on one side,
+ * and on the other, in the direction of (stepX, stepY), at least three
+ * room spots in a row
+ *
+ */
+static bool
+findDoorway(grid_t* grid, int* doorX, int* doorY, int* stepX, int* stepY)
+{
+  static const int directionX[] = { 1, -1, 0, 0 };
+  static const int directionY[] = { 0, 0, 1, -1 };
+  int rows = grid_numrows(grid);
+  int cols = grid_numcols(grid);
+
+  for (int y = 3; y < rows - 3; ++y){
+    for (int x = 3; x < cols - 3; ++x){
+      if (grid_charAt(grid, x, y) != mapchars_passageSpot){
+        continue;
+      }
+      for (int s = 0; s < 4; ++s){
+        int dx = directionX[s];
+        int dy = directionY[s];
+        if (grid_charAt(grid, x - dx, y - dy) == mapchars_passageSpot
+            && grid_charAt(grid, x + dx, y + dy) == mapchars_roomSpot
+            && grid_charAt(grid, x + 2 * dx, y + 2 * dy) == mapchars_roomSpot
+            && grid_charAt(grid, x + 3 * dx, y + 3 * dy) == mapchars_roomSpot){
+          *doorX = x;
+          *doorY = y;
+          *stepX = dx;
+          *stepY = dy;
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+/****************** checkDisplays ************************
+ *
+ * reads every message waiting for each player, keeping the last DISPLAY,
+ * and compares it with their view worked out afresh; returns how many
+ * differ, saying which
+ *
+ */
+static int
+checkDisplays(game_t* game, client_t* clients, const int numPlayers,
+              char* display, const int keyNumber)
+{
+  playertable_t* players = game_getPlayers(game);
+  grid_t* master = game_masterGrid(game);
+  char buffer[message_MaxBytes];
+  int numMismatches = 0;
+
+  for (int i = 0; i < numPlayers; ++i){
+    client_t* client = &clients[i];
+    ssize_t length;
+    while ((length = recv(client->socket, buffer, sizeof(buffer) - 1, 0)) >= 0){
+      buffer[length] = '\0';
+      if (strncmp(buffer, displayHeader, strlen(displayHeader)) == 0){
+        strcpy(client->lastDisplay, buffer + strlen(displayHeader));
+      }
+    }
+
+    if (!players->isActive[i]){
+      continue;
+    }
+    client->visibleGrid = grid_generateVisibleGrid(master, client->visibleGrid,
+                                                   players->x[i], players->y[i]);
+    grid_composeView(master, client->visibleGrid, display);
+    if (strcmp(display, client->lastDisplay) != 0){
+      printf("after key %d, player %c was last sent a stale display\n",
+             keyNumber, players->letter[i]);
+      ++numMismatches;
+    }
+  }
+  return numMismatches;
+}
+
+/****************** pressKey *****************************
+ *
+ * handles a single-step KEY from a player the way the server does, returning
+ * whether the game is over
+ *
+ */
+static bool
+pressKey(game_t* game, addr_t from, const char key)
+{
+  game_resetScratch(game);
+
+  int dx = 0;
+  int dy = 0;
+  switch (key){
+    case 'h': dx = -1;          break;
+    case 'l': dx =  1;          break;
+    case 'j':          dy =  1; break;
+    case 'k':          dy = -1; break;
+    case 'y': dx = -1; dy = -1; break;
+    case 'u': dx =  1; dy = -1; break;
+    case 'b': dx = -1; dy =  1; break;
+    case 'n': dx =  1; dy =  1; break;
+  }
+  return game_move(game, from, dx, dy);
+}
@@ -0,0 +1,256 @@
+/*
+ * jobs.c - a file implementing the jobs module for
+ * the cs50 nuggets game
+ *
+ * usage and description is given in jobs.h
+ *
+ * Each worker owns a contiguous range of task indices. Tasks are claimed
+ * with an atomic fetch-and-add on the range's 'next' index, which is what
+ * the owner does to take its own work and also what a thief does to steal
+ * it, so no task can ever be claimed twice and no locks are taken while
+ * tasks are being handed out. The mutex and condition variables are only
+ * used to wake the pool up at the start of a batch and to wait for it at
+ * the end.
+ *
+ * Ribhu Hooja, March 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "jobs.h"
+#include "mem.h"
+
+/****************** types ********************************/
+typedef struct queue {
+  atomic_int next;      // next unclaimed task index in this range
+  int end;              // one past the last task index in this range
+} queue_t;
+
+typedef struct worker {
+  struct jobs* jobs;    // the job system this worker belongs to
+  int id;               // index of this worker, in [1, numWorkers)
+  pthread_t thread;     // the thread running this worker
+} worker_t;
+
+typedef struct jobs {
+  int numWorkers;           // number of workers, including the caller
+  worker_t* workers;        // the pool threads; workers[0] is unused
+  queue_t* queues;          // one range of task indices per worker
+
+  pthread_mutex_t lock;     // protects everything below
+  pthread_cond_t start;     // signalled when a new batch is ready
+  pthread_cond_t done;      // signalled when the last pool thread finishes
+  unsigned long batch;      // incremented for every batch
+  int numBusy;              // pool threads still working on this batch
+  bool shutdown;            // whether the pool threads should exit
+
+  // the batch currently being run
+  void (*task)(void* arg, const int index, const int worker);
+  void* arg;
+} jobs_t;
+
+/****************** local function prototypes ************/
+static void* workerMain(void* pWorker);
+static void runTasks(jobs_t* jobs, const int worker);
+
+/****************** jobs_new ******************************
+ *
+ * see jobs.h for usage and description
+ *
+ */
+jobs_t*
+jobs_new(const int numWorkers)
+{
+  jobs_t* jobs = mem_malloc_assert(sizeof(jobs_t), "out of memory; could not create job system\n");
+
+  jobs->numWorkers = numWorkers < 1 ? 1 : numWorkers;
+  jobs->queues = mem_calloc_assert(jobs->numWorkers, sizeof(queue_t), "out of memory\n");
+  jobs->workers = mem_calloc_assert(jobs->numWorkers, sizeof(worker_t), "out of memory\n");
+  jobs->batch = 0;
+  jobs->numBusy = 0;
+  jobs->shutdown = false;
+  jobs->task = NULL;
+  jobs->arg = NULL;
+
+  pthread_mutex_init(&jobs->lock, NULL);
+  pthread_cond_init(&jobs->start, NULL);
+  pthread_cond_init(&jobs->done, NULL);
+
+  for (int i = 0; i < jobs->numWorkers; ++i){
+    atomic_init(&jobs->queues[i].next, 0);
+    jobs->queues[i].end = 0;
+  }
+
+  // worker 0 is the thread that calls jobs_run; only start the others
+  for (int i = 1; i < jobs->numWorkers; ++i){
+    worker_t* worker = &jobs->workers[i];
+    worker->jobs = jobs;
+    worker->id = i;
+    if (pthread_create(&worker->thread, NULL, workerMain, worker) != 0){
+      // carry on with however many threads we managed to start
+      fprintf(stderr, "jobs_new: could only start %d workers\n", i);
+      jobs->numWorkers = i;
+      break;
+    }
+  }
+
+  return jobs;
+}
+
+/****************** jobs_numWorkers ***********************
+ *
+ * see jobs.h for usage and description
+ *
+ */
+int
+jobs_numWorkers(jobs_t* jobs)
+{
+  if (jobs == NULL){
+    return 1;
+  }
+
+  return jobs->numWorkers;
+}
+
+/****************** jobs_run ******************************
+ *
+ * see jobs.h for usage and description
+ *
+ */
+void
+jobs_run(jobs_t* jobs, const int numTasks,
+         void (*task)(void* arg, const int index, const int worker), void* arg)
+{
+  if (jobs == NULL || task == NULL || numTasks <= 0){
+    return;
+  }
+
+  // not worth waking the pool up for; run inline
+  if (jobs->numWorkers == 1 || numTasks == 1){
+    for (int i = 0; i < numTasks; ++i){
+      (*task)(arg, i, 0);
+    }
+    return;
+  }
+
+  // split the batch evenly; the first (numTasks % numWorkers) ranges
+  // get one extra task
+  const int numWorkers = jobs->numWorkers;
+  int begin = 0;
+  for (int i = 0; i < numWorkers; ++i){
+    int size = numTasks / numWorkers + (i < numTasks % numWorkers ? 1 : 0);
+    atomic_store(&jobs->queues[i].next, begin);
+    jobs->queues[i].end = begin + size;
+    begin += size;
+  }
+
+  pthread_mutex_lock(&jobs->lock);
+  jobs->task = task;
+  jobs->arg = arg;
+  jobs->numBusy = numWorkers - 1;
+  ++jobs->batch;
+  pthread_cond_broadcast(&jobs->start);
+  pthread_mutex_unlock(&jobs->lock);
+
+  // the caller works too, as worker 0
+  runTasks(jobs, 0);
+
+  // barrier: wait for the pool to finish the batch
+  pthread_mutex_lock(&jobs->lock);
+  while (jobs->numBusy > 0){
+    pthread_cond_wait(&jobs->done, &jobs->lock);
+  }
+  jobs->task = NULL;
+  jobs->arg = NULL;
+  pthread_mutex_unlock(&jobs->lock);
+}
+
+/****************** jobs_delete ***************************
+ *
+ * see jobs.h for usage and description
+ *
+ */
+void
+jobs_delete(jobs_t* jobs)
+{
+  if (jobs == NULL){
+    return;
+  }
+
+  pthread_mutex_lock(&jobs->lock);
+  jobs->shutdown = true;
+  pthread_cond_broadcast(&jobs->start);
+  pthread_mutex_unlock(&jobs->lock);
+
+  for (int i = 1; i < jobs->numWorkers; ++i){
+    pthread_join(jobs->workers[i].thread, NULL);
+  }
+
+  pthread_cond_destroy(&jobs->done);
+  pthread_cond_destroy(&jobs->start);
+  pthread_mutex_destroy(&jobs->lock);
+
+  mem_free(jobs->workers);
+  mem_free(jobs->queues);
+  mem_free(jobs);
+}
+
+/****************** workerMain ****************************
+ *
+ * the body of every pool thread: sleep until a batch is
+ * ready, help run it, and report back when done
+ *
+ */
+static void*
+workerMain(void* pWorker)
+{
+  worker_t* worker = pWorker;
+  jobs_t* jobs = worker->jobs;
+  unsigned long seenBatch = 0;
+
+  pthread_mutex_lock(&jobs->lock);
+  while (true){
+    while (!jobs->shutdown && jobs->batch == seenBatch){
+      pthread_cond_wait(&jobs->start, &jobs->lock);
+    }
+    if (jobs->shutdown){
+      break;
+    }
+    seenBatch = jobs->batch;
+    pthread_mutex_unlock(&jobs->lock);
+
+    runTasks(jobs, worker->id);
+
+    pthread_mutex_lock(&jobs->lock);
+    if (--jobs->numBusy == 0){
+      pthread_cond_signal(&jobs->done);
+    }
+  }
+  pthread_mutex_unlock(&jobs->lock);
+
+  return NULL;
+}
+
+/****************** runTasks ******************************
+ *
+ * runs the worker's own range of tasks, then steals from the
+ * other workers' ranges until there is nothing left anywhere
+ *
+ */
+static void
+runTasks(jobs_t* jobs, const int worker)
+{
+  const int numWorkers = jobs->numWorkers;
+
+  // start with our own range, then go round the others
+  for (int i = 0; i < numWorkers; ++i){
+    queue_t* queue = &jobs->queues[(worker + i) % numWorkers];
+    int index;
+    while ((index = atomic_fetch_add(&queue->next, 1)) < queue->end){
+      (*jobs->task)(jobs->arg, index, worker);
+    }
+  }
+}
@@ -0,0 +1,79 @@
+/*
+ * jobs - a small work-stealing job system for the nuggets server
+ *
+ * A jobs_t owns a fixed pool of worker threads. The caller hands it a
+ * batch of independent, numbered tasks with jobs_run; the batch is split
+ * evenly between the workers, and a worker that runs out of tasks steals
+ * from the others. jobs_run only returns once every task in the batch has
+ * finished, so it also acts as a barrier between batches.
+ *
+ * Ribhu Hooja, March 2024
+ */
+
+#ifndef __JOBS_H
+#define __JOBS_H
+
+/****************** global types *************************/
+typedef struct jobs jobs_t;
+
+/****************** functions ****************************/
+
+/****************** jobs_new ******************************
+ *
+ * creates a new job system
+ *
+ * Caller provides:
+ *  the number of workers to use, including the calling thread
+ *  (values less than 1 are treated as 1, i.e. run everything inline)
+ * We return:
+ *  A new, valid heap allocated jobs_t*
+ *  NULL if error
+ * Caller is responsible for:
+ *  Later calling jobs_delete on the returned pointer
+ */
+jobs_t* jobs_new(const int numWorkers);
+
+/****************** jobs_numWorkers ***********************
+ *
+ * Caller provides:
+ *  valid pointer to a job system
+ * We return:
+ *  the number of workers, including the calling thread
+ *  1 if error
+ */
+int jobs_numWorkers(jobs_t* jobs);
+
+/****************** jobs_run ******************************
+ *
+ * runs a batch of tasks across the workers
+ *
+ * Caller provides:
+ *  valid pointer to a job system
+ *  the number of tasks in the batch
+ *  a task function, and an arg that is passed through to it untouched
+ * We do:
+ *  call task(arg, index, worker) exactly once for every index in
+ *  [0, numTasks), where worker is in [0, jobs_numWorkers) and identifies
+ *  the thread running the task (the caller is always worker 0)
+ *  return only when all the tasks have completed
+ * Notes:
+ *  Tasks in the same batch run concurrently, so they must not write to
+ *  shared state without their own synchronization. jobs_run must not be
+ *  called from inside a task.
+ */
+void jobs_run(jobs_t* jobs, const int numTasks,
+              void (*task)(void* arg, const int index, const int worker),
+              void* arg);
+
+/****************** jobs_delete ***************************
+ *
+ * deletes a job system
+ *
+ * Caller provides:
+ *  valid pointer to a job system, not currently inside jobs_run
+ * We do:
+ *  stop and join all the worker threads, and free all associated memory
+ */
+void jobs_delete(jobs_t* jobs);
+
+#endif    // __JOBS_H
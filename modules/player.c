@@ -7,6 +7,7 @@
  * 
  * Author: Tayeb Mohammadi, February 2024
  * Modified: Ribhu Hooja, February 2024
+ * Modified: Ribhu Hooja, March 2024 - players live in a table of arrays
  * 
  */
 
@@ -17,53 +18,187 @@
 #include "grid.h"
 #include "message.h"
 #include "player.h"
+#include "arena.h"
 #include "log.h"
 #include "mem.h"
 
 
 /******************* types *******************************/
+// everything about a player is in its table; see player.h
 typedef struct player {
-  int x;                 // x-coordinate of the player
-  int y;                 // y-coordinate of the player
-  grid_t* visibleGrid;   // the grid that the player can see
-  int gold;              // the gold collected by the player
-  char* name;            // the name of the player
-  bool isActive;         // whether the player is active
-  char letter;           // the character representation of the player on the map
-  addr_t address;        // the address of the player client, for sending messages
+  playertable_t* table;  // the table the player is in
+  int id;                // the player's index into the table's arrays
 } player_t;
 
-/****************** player_new ****************************
+/****************** local functions **********************/
+static unsigned long long addressKey(const addr_t address);
+
+/****************** playertable_new ***********************
+ *
+ * see player.h for description and usage
+ *
+ */
+playertable_t*
+playertable_new(const int capacity, arena_t* arena)
+{
+  if (capacity <= 0 || arena == NULL){
+    return NULL;
+  }
+
+  const char* error = "Failed to allocate memory for player table";
+  playertable_t* table = mem_assert(arena_alloc(arena, sizeof(playertable_t)), error);
+  table->capacity = capacity;
+  table->count = 0;
+  table->x = mem_assert(arena_alloc(arena, capacity * sizeof(int)), error);
+  table->y = mem_assert(arena_alloc(arena, capacity * sizeof(int)), error);
+  table->gold = mem_assert(arena_alloc(arena, capacity * sizeof(int)), error);
+  table->isActive = mem_assert(arena_alloc(arena, capacity * sizeof(bool)), error);
+  table->viewChanged = mem_assert(arena_alloc(arena, capacity * sizeof(bool)), error);
+  table->letter = mem_assert(arena_alloc(arena, capacity * sizeof(char)), error);
+  table->name = mem_assert(arena_alloc(arena, capacity * sizeof(char*)), error);
+  table->visibleGrid = mem_assert(arena_alloc(arena, capacity * sizeof(grid_t*)), error);
+  table->address = mem_assert(arena_alloc(arena, capacity * sizeof(addr_t)), error);
+  table->addressKey = mem_assert(arena_alloc(arena, capacity * sizeof(unsigned long long)), error);
+  table->views = mem_assert(arena_alloc(arena, capacity * sizeof(player_t)), error);
+  table->arena = arena;
+
+  for (int id = 0; id < capacity; ++id){
+    table->views[id].table = table;
+    table->views[id].id = id;
+  }
+
+  return table;
+}
+
+/****************** playertable_delete ********************
+ *
+ * see player.h for description and usage
+ *
+ */
+void
+playertable_delete(playertable_t* table)
+{
+  if (table == NULL){
+    return;
+  }
+
+  for (int id = 0; id < table->count; ++id){
+    player_delete(&table->views[id]);
+  }
+}
+
+/****************** playertable_get ***********************
  *
  * see player.h for description and usage
  *
  */
 player_t*
-player_new (addr_t address, int x, int y, const char* name, char letter )
+playertable_get(playertable_t* table, const int id)
 {
-  if (name == NULL){
+  if (table == NULL || id < 0 || id >= table->count){
     return NULL;
   }
 
-  player_t* player = mem_malloc_assert(sizeof(player_t), "Failed to allocate memory for player");
+  return &table->views[id];
+}
 
+/****************** playertable_findAddress ***************
+ *
+ * see player.h for description and usage
+ *
+ */
+int
+playertable_findAddress(const playertable_t* table, const addr_t address)
+{
+  if (table == NULL){
+    return -1;
+  }
+
+  unsigned long long key = addressKey(address);
+  for (int id = 0; id < table->count; ++id){
+    if (table->addressKey[id] == key){
+      return id;
+    }
+  }
+
+  return -1;
+}
+
+/****************** playertable_findAt ********************
+ *
+ * see player.h for description and usage
+ *
+ */
+int
+playertable_findAt(const playertable_t* table, const int x, const int y)
+{
+  if (table == NULL){
+    return -1;
+  }
+
+  // no early exit, so the compiler can vectorize the comparisons;
+  // there is at most one active player on any spot anyway
+  int found = -1;
+  for (int id = table->count - 1; id >= 0; --id){
+    if (table->isActive[id] & (table->x[id] == x) & (table->y[id] == y)){
+      found = id;
+    }
+  }
+
+  return found;
+}
+
+/****************** player_new ****************************
+ *
+ * see player.h for description and usage
+ *
+ */
+player_t*
+player_new (playertable_t* table, addr_t address, int x, int y,
+            const char* name, char letter)
+{
+  if (table == NULL || name == NULL){
+    return NULL;
+  }
+  if (table->count == table->capacity){
+    flog_v(stderr, "Cannot add a player to a full table.\n");
+    return NULL;
+  }
+
+  int id = table->count++;
   int len = strlen(name);
 
-  player->name = mem_malloc_assert((len + 1) * sizeof(char), "Failed to allocate memory for name of the player");
-  strncpy(player->name, name, len + 1); // make a copy of the passed in string
+  table->name[id] = mem_assert(arena_alloc(table->arena, (len + 1) * sizeof(char)), "Failed to allocate memory for name of the player");
+  strncpy(table->name[id], name, len + 1); // make a copy of the passed in string
 
-  player->letter = letter;
-  player->x = x;
-  player->y = y;
-  player->isActive = true;
-  player->address= address;
-  player->gold = 0; // start off a new player with 0 gold
+  table->letter[id] = letter;
+  table->x[id] = x;
+  table->y[id] = y;
+  table->isActive[id] = true;
+  table->address[id] = address;
+  table->addressKey[id] = addressKey(address);
+  table->gold[id] = 0; // start off a new player with 0 gold
 
-  player->visibleGrid = NULL;
+  table->visibleGrid[id] = NULL;
+  table->viewChanged[id] = true;   // never displayed
 
-  return player;
+  return &table->views[id];
 }
 
+/****************** player_getId **************************
+ *
+ * see player.h for description and usage
+ *
+ */
+int
+player_getId(const player_t* player)
+{
+  if (player == NULL){
+    return -1;
+  }
+
+  return player->id;
+}
 
 /****************** player_delete *************************
  *
@@ -77,10 +212,9 @@ player_delete(player_t* player)
     return;
   }
 
-  mem_free(player->name); 
-  grid_delete(player->visibleGrid);
-  mem_free(player); 
-
+  // the table's arena frees the rest
+  grid_delete(player->table->visibleGrid[player->id]);
+  player->table->visibleGrid[player->id] = NULL;
 }
 
 /****************** player_getX ****************************
@@ -96,7 +230,7 @@ player_getX(const player_t* player)
         return -1;
     }
 
-    return player->x;
+    return player->table->x[player->id];
 }
 
 /****************** player_getY ****************************
@@ -112,7 +246,7 @@ player_getY(const player_t* player)
         return -1;
     }
 
-    return player->y;
+    return player->table->y[player->id];
 }
 
 /****************** player_getY ****************************
@@ -128,7 +262,7 @@ player_getVisibleGrid(const player_t* player)
         return NULL;
     }
 
-    return player->visibleGrid;
+    return player->table->visibleGrid[player->id];
 }
 
 /****************** player_getGold ****************************
@@ -144,7 +278,7 @@ player_getGold(const player_t* player)
         return 0;
     }
 
-    return player->gold;
+    return player->table->gold[player->id];
 
 }
 
@@ -161,7 +295,7 @@ player_getName(const player_t* player)
         return NULL;
     }
 
-    return player->name;
+    return player->table->name[player->id];
 }
 
 /****************** player_getLetter ****************************
@@ -176,7 +310,7 @@ player_getLetter(const player_t* player)
         flog_v(stderr, "Cannot get letter of null player.\n");
         return '\0';
     }
-    return player->letter;
+    return player->table->letter[player->id];
 }
 
 /****************** player_getAddress ****************************
@@ -192,7 +326,7 @@ player_getAddress(const player_t* player)
         return message_noAddr(); 
     }
 
-    return player->address;
+    return player->table->address[player->id];
 }
 
 /****************** player_isActive ***********************
@@ -207,7 +341,7 @@ player_isActive(player_t* player)
     return false;
   }
 
-  return player->isActive;
+  return player->table->isActive[player->id];
 }
 
 /****************** player_setX ****************************
@@ -223,7 +357,7 @@ player_setX(player_t* player, int x)
         return;
     }
 
-    player->x = x;
+    player->table->x[player->id] = x;
 }
 
 /****************** player_setY ****************************
@@ -239,7 +373,7 @@ player_setY(player_t* player, int y)
         return;
     }
 
-    player->y = y;
+    player->table->y[player->id] = y;
 }
 
 /****************** player_setGold ****************************
@@ -255,7 +389,7 @@ player_setGold(player_t* player, int gold)
         return;
     }
 
-    player->gold = gold;
+    player->table->gold[player->id] = gold;
 
 }
 
@@ -272,7 +406,7 @@ player_addGold(player_t* player, int gold)
     return;
   }
 
-  player->gold += gold;
+  player->table->gold[player->id] += gold;
 }
 
 /****************** player_setInactive ****************************
@@ -289,7 +423,7 @@ player_setInactive(player_t* player)
         return;
     }
 
-    player->isActive = false;
+    player->table->isActive[player->id] = false;
 
 }
 
@@ -307,7 +441,7 @@ player_moveX(player_t* player, int direction)
         return;
     }
 
-    player->x += direction;
+    player->table->x[player->id] += direction;
 
 }
 
@@ -325,7 +459,7 @@ player_moveY(player_t* player, int direction)
         return;
     }
 
-    player->y += direction;
+    player->table->y[player->id] += direction;
 
 }
 
@@ -343,8 +477,8 @@ player_moveDiagonal(player_t* player, int Xdirection, int Ydirection)
         return;
     }
 
-    player->x += Xdirection;
-    player->y += Ydirection;
+    player->table->x[player->id] += Xdirection;
+    player->table->y[player->id] += Ydirection;
 
 }
 
@@ -363,10 +497,79 @@ player_updateVisibleGrid(player_t* player, grid_t* masterGrid)
         return;
     }
 
-    player->visibleGrid = grid_generateVisibleGrid(masterGrid, 
-                                                   player->visibleGrid,
-                                                   player->x,
-                                                   player->y);
+    playertable_t* table = player->table;
+    int id = player->id;
+    table->visibleGrid[id] = grid_generateVisibleGrid(masterGrid, 
+                                                      table->visibleGrid[id],
+                                                      table->x[id],
+                                                      table->y[id]);
+
+    // remember any change until the display is next sent; a long move
+    // updates the grid several times between displays
+    if (grid_numChanged(table->visibleGrid[id]) > 0){
+        table->viewChanged[id] = true;
+    }
+}
+
+/****************** player_refreshVisibleGrid ****************************
+ *
+ * see player.h for description and usage
+ *
+ */
+void
+player_refreshVisibleGrid(player_t* player, grid_t* masterGrid,
+                          const int* cells, const int numCells)
+{
+    if(player == NULL){
+        flog_v(stderr, "Cannot refresh grid for null player.\n");
+        return;
+    }
+
+    playertable_t* table = player->table;
+    int id = player->id;
+
+    // nothing to refresh until the grid has been generated once
+    if (table->visibleGrid[id] == NULL){
+        player_updateVisibleGrid(player, masterGrid);
+        return;
+    }
+
+    if (grid_refreshVisibleGrid(masterGrid, table->visibleGrid[id], table->x[id],
+                                table->y[id], cells, numCells)
+        && grid_numChanged(table->visibleGrid[id]) > 0){
+        table->viewChanged[id] = true;
+    }
+}
+
+/****************** player_viewChanged ****************************
+ *
+ * see player.h for description and usage
+ *
+ */
+bool
+player_viewChanged(const player_t* player)
+{
+    if(player == NULL){
+        return false;
+    }
+
+    return player->table->viewChanged[player->id];
+}
+
+/****************** player_clearViewChanged ****************************
+ *
+ * see player.h for description and usage
+ *
+ */
+void
+player_clearViewChanged(player_t* player)
+{
+    if(player == NULL){
+        flog_v(stderr, "Cannot clear view of null player.\n");
+        return;
+    }
+
+    player->table->viewChanged[player->id] = false;
 }
 
 /****************** player_sendMessage ****************************
@@ -382,5 +585,33 @@ player_sendMessage(player_t* player, char* message)
         return;
     }
 
-    message_send(player->address, message);
+    message_send(player->table->address[player->id], message);
+}
+
+/****************** player_sendDisplay ****************************
+ *
+ * see player.h for description and usage
+ *
+ */
+void
+player_sendDisplay(player_t* player, const char* display)
+{
+    if(player == NULL || display == NULL){
+        flog_v(stderr, "Cannot send display for null player or display.\n");
+        return;
+    }
+
+    message_sendParts(player->table->address[player->id], "DISPLAY\n", display);
+}
+
+/****************** addressKey ****************************
+ *
+ * packs an address into one number, equal for equal addresses
+ * (in the sense of message_eqAddr)
+ *
+ */
+static unsigned long long
+addressKey(const addr_t address)
+{
+  return (unsigned long long) address.sin_addr.s_addr << 16 | address.sin_port;
 }
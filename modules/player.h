@@ -8,6 +8,7 @@
  * Tayeb Mohammadi, Febuary 2024
  * Ribhu Hooja, Febuary 2024 - made opaque, protected from multiple includes,
  * added functionality needed by grid
+ * Ribhu Hooja, March 2024 - players now live in a table of arrays
  * 
  */
 
@@ -18,25 +19,123 @@
 #include <stdbool.h>
 #include "message.h"
 #include "grid.h"
+#include "arena.h"
 
 /****************** global types *************************/
+// a view of one player in a player table
 typedef struct player player_t;
 
+/****************** the player table *********************
+ *
+ * The players of a game, stored as one array per field and indexed by
+ * player id (0 for the first player to join, and so on), so that scans
+ * over every player touch only the fields they need. The game reads the
+ * arrays directly; everyone else goes through the player_t views.
+ *
+ * Ids are never reused; a player who leaves is marked inactive.
+ */
+typedef struct playertable {
+  int capacity;             // number of ids the table has room for
+  int count;                // ids 0..count-1 are in use
+  int* x;                   // x-coordinate of each player
+  int* y;                   // y-coordinate of each player
+  int* gold;                // the gold collected by each player
+  bool* isActive;           // whether each player is still in the game
+  bool* viewChanged;        // whether visibleGrid changed since its last display
+  char* letter;             // the letter of each player on the map
+  char** name;              // the name of each player
+  grid_t** visibleGrid;     // the grid that each player can see
+  addr_t* address;          // the address of each player's client
+  unsigned long long* addressKey;  // the same addresses, packed for searching
+  player_t* views;          // the view of each player
+  arena_t* arena;           // where all of the above lives
+} playertable_t;
+
+/****************** playertable_new ***********************
+ *
+ * creates an empty player table
+ *
+ * Caller provides:
+ *  the most players the table will ever hold
+ *  an arena to allocate the table from
+ * We return:
+ *  the new table, NULL on error
+ * Caller is responsible for:
+ *  calling playertable_delete before deleting the arena, which frees
+ *  the rest of the table
+ */
+playertable_t* playertable_new(const int capacity, arena_t* arena);
+
+/****************** playertable_delete ********************
+ *
+ * deletes the visible grids of every player in the table
+ *
+ * Caller provides:
+ *  valid pointer to a player table
+ */
+void playertable_delete(playertable_t* table);
+
+/****************** playertable_get ***********************
+ *
+ * returns the view of the player with the given id
+ *
+ * Caller provides:
+ *  valid pointer to a player table, and an id
+ * We return:
+ *  the player; NULL if no player has that id
+ */
+player_t* playertable_get(playertable_t* table, const int id);
+
+/****************** playertable_findAddress ***************
+ *
+ * finds the player whose client has the given address
+ *
+ * Caller provides:
+ *  valid pointer to a player table, and an address
+ * We return:
+ *  the id of that player, active or not; -1 if there is none
+ */
+int playertable_findAddress(const playertable_t* table, const addr_t address);
+
+/****************** playertable_findAt ********************
+ *
+ * finds the active player standing at the given coordinates
+ *
+ * Caller provides:
+ *  valid pointer to a player table, and the coordinates
+ * We return:
+ *  the id of that player; -1 if there is none
+ */
+int playertable_findAt(const playertable_t* table, const int x, const int y);
+
 /************* player_new *************/
-/* Creates a new player struct
+/* Creates a new player in a player table
  * Caller provides: 
+ *  the table to add the player to
  *  (x,y) coordinates, name and address of client who is using the player
  * We do: 
- *  Initialize a new player_t* data struct with the parameters
+ *  Give the player the next id in the table, and initialize it with the
+ *  parameters
  * We return:
- *  The initialized player, NULL if any failure
+ *  The view of the new player, NULL if any failure (or the table is full)
  * Notes:
  * The name is COPIED, not stored
- * the caller should free memory for name and the player structure 
- *  when done.
+ * the player and its name are freed with the table's arena, but the caller
+ *  should call player_delete (or playertable_delete) first
  *
 */
-player_t* player_new (addr_t address, int x, int y, const char* name, char letter );
+player_t* player_new (playertable_t* table, addr_t address, int x, int y,
+                      const char* name, char letter);
+
+/************* player_getId *************/
+/* 
+ * Get the id of the player in its table
+ * Caller provides: 
+ *  A pointer to the player
+ * We return: 
+ *  The player's id, -1 on failure
+ */
+int player_getId(const player_t* player);
 
 
 /************* player_delete *************/
@@ -44,7 +143,8 @@ player_t* player_new (addr_t address, int x, int y, const char* name, char lette
  * Caller provides: 
  *  the player to delete
  * We do: 
- *  Delete the player, freeing all associated structs and their memory
+ *  Delete the player's visible grid; everything else belongs to the
+ *  table's arena
  *
 */
 void player_delete(player_t* player);
@@ -236,6 +336,43 @@ void player_moveDiagonal(player_t* player, int Xdirection, int Ydirection);
  */
 void player_updateVisibleGrid(player_t* player, grid_t* masterGrid);
 
+/************* player_refreshVisibleGrid *************/
+/* 
+ * Update only some cells of the visible grid of a player who has not moved
+ * since their visible grid was last calculated
+ * Caller provides: 
+ *  A pointer to the player and a pointer to the master grid
+ *  the string indices of the cells that may have changed, and how many
+ * We do: 
+ *  Bring just those cells of the player's grid up to date; the result is
+ *  the same as player_updateVisibleGrid, as long as no other cell changed
+ */
+void player_refreshVisibleGrid(player_t* player, grid_t* masterGrid,
+                               const int* cells, const int numCells);
+
+/************* player_viewChanged *************/
+/* 
+ * Has the player's visible grid changed since it was last displayed?
+ * Caller provides: 
+ *  A pointer to the player
+ * We return: 
+ *  true if any player_updateVisibleGrid or player_refreshVisibleGrid call
+ *  changed the visible grid
+ *  since the last player_clearViewChanged (or since the player was made)
+ *  false otherwise, or on failure
+ */
+bool player_viewChanged(const player_t* player);
+
+/************* player_clearViewChanged *************/
+/* 
+ * Record that the player's current visible grid has been displayed
+ * Caller provides: 
+ *  A pointer to the player
+ * We do: 
+ *  Reset the flag returned by player_viewChanged
+ */
+void player_clearViewChanged(player_t* player);
+
 /************* player_setInactive *************/
 /* 
  * Set the isIactive of the player to false 
@@ -257,6 +394,17 @@ void player_setInactive(player_t* player);
  */
 void player_sendMessage(player_t* player, char* message);
 
+/************* player_sendDisplay *************/
+/* 
+ * Send a DISPLAY message to a player
+ * Caller provides: 
+ *  A pointer to the player and the display string, e.g. from grid_displayView
+ * We do: 
+ *  Send "DISPLAY\n" followed by the display to the player, without copying
+ *  the display
+ */
+void player_sendDisplay(player_t* player, const char* display);
+
 /****************** player_isActive ****************************/
 /* 
  * Send message to a player
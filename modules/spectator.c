@@ -56,3 +56,12 @@ void spectator_sendMessage(spectator_t* spectator, char* message){
     }
     message_send(spectator->address, message);
 }
+
+// to send a DISPLAY message to a spectator. Check spectator.h for more information 
+void spectator_sendDisplay(spectator_t* spectator, const char* display){
+    if(spectator == NULL || display == NULL){
+        flog_v(stderr, "Cannot send display for null spectator or display.\n");
+        return;
+    }
+    message_sendParts(spectator->address, "DISPLAY\n", display);
+}
@@ -58,4 +58,15 @@ void spectator_delete(spectator_t* spectator);
  */
 void spectator_sendMessage(spectator_t* spectator, char* message);
 
+/************* spectator_sendDisplay *************/
+/* 
+ * Send a DISPLAY message to a spectator
+ * Caller provides: 
+ *  A pointer to the spectator and the display string, e.g. from grid_displayView
+ * We do: 
+ *  Send "DISPLAY\n" followed by the display to the spectator, without
+ *  copying the display
+ */
+void spectator_sendDisplay(spectator_t* spectator, const char* display);
+
 #endif // SPECTATOR_H
@@ -30,6 +30,7 @@ main()
   int py = 18;
   char letter = 'A';
   grid_t* visibleGrid = NULL;
+  char* display = malloc(grid_displayLength(grid) + 1);
 
   srand(42);
   grid_nuggetsPopulate(grid, 10, 30, 250);
@@ -40,21 +41,21 @@ main()
 
   printf("Now calculating the grid visible to the player\n\n");
   visibleGrid = grid_generateVisibleGrid(grid, visibleGrid, px, py);
-  grid_toMap(visibleGrid, stdout);
+  fputs(grid_composeView(grid, visibleGrid, display), stdout);
 
   printf("beginning logging..\n");
   for (int i = 0; i < 5; ++i){
     grid_movePlayer(grid, px, py, 0, -1);
     --py;
     grid_generateVisibleGrid(grid, visibleGrid, px, py);
-    grid_toMap(visibleGrid, log);
+    fputs(grid_composeView(grid, visibleGrid, display), log);
   }
 
   for (int i = 0; i < 27; ++i){
     grid_movePlayer(grid, px, py, 1, 0);
     ++px;
     grid_generateVisibleGrid(grid, visibleGrid, px, py);
-    grid_toMap(visibleGrid, log);
+    fputs(grid_composeView(grid, visibleGrid, display), log);
   }
   
   for (int i = 0; i < 3; ++i){
@@ -62,7 +63,7 @@ main()
     ++px;
     ++py;
     grid_generateVisibleGrid(grid, visibleGrid, px, py);
-    grid_toMap(visibleGrid, log);
+    fputs(grid_composeView(grid, visibleGrid, display), log);
   }
   
   for (int i = 0; i < 10; ++i){
@@ -71,7 +72,7 @@ main()
       ++px;
     }
     grid_generateVisibleGrid(grid, visibleGrid, px, py);
-    grid_toMap(visibleGrid, log);
+    fputs(grid_composeView(grid, visibleGrid, display), log);
   }
   
   for (int i = 0; i < 10; ++i){
@@ -80,12 +81,114 @@ main()
       --py;
     }
     grid_generateVisibleGrid(grid, visibleGrid, px, py);
-    grid_toMap(visibleGrid, log);
+    fputs(grid_composeView(grid, visibleGrid, display), log);
   }
 
 
   fclose(log);
 
+  // a second player stands still while the first wanders about; refreshing
+  // only the changed cells must give the same view as recalculating it all
+  printf("Checking refreshed views against full recalculations\n");
+  int qx, qy;
+  grid_findRandomSpawnPosition(grid, &qx, &qy);
+  grid_addPlayer(grid, qx, qy, 'B');
+  grid_publish(grid);
+  grid_t* refreshedGrid = grid_generateVisibleGrid(grid, NULL, qx, qy);
+  grid_t* fullGrid = grid_generateVisibleGrid(grid, NULL, qx, qy);
+
+  int numRefreshed = 0;
+  int numMismatches = 0;
+  for (int i = 0; i < 500; ++i){
+    int dx = rand() % 3 - 1;
+    int dy = rand() % 3 - 1;
+    if (grid_movePlayer(grid, px, py, dx, dy) >= 0){
+      px += dx;
+      py += dy;
+    }
+    grid_publish(grid);
+
+    int reader;
+    grid_t* snapshot = grid_snapshotAcquire(grid, &reader);
+    int numCells;
+    const int* cells = grid_changedCells(snapshot, &numCells);
+    if (cells == NULL){
+      grid_generateVisibleGrid(snapshot, refreshedGrid, qx, qy);
+    } else {
+      grid_refreshVisibleGrid(snapshot, refreshedGrid, qx, qy, cells, numCells);
+      ++numRefreshed;
+    }
+    grid_generateVisibleGrid(snapshot, fullGrid, qx, qy);
+    if (!grid_viewEquals(snapshot, refreshedGrid, fullGrid)){
+      ++numMismatches;
+    }
+    grid_snapshotRelease(grid, reader);
+  }
+  printf("%d refreshes, %d mismatches\n", numRefreshed, numMismatches);
+
+  // from every room spot, the room index must see exactly what rays see
+  printf("Checking the room index against ray tests\n");
+  int numSpots = 0;
+  numMismatches = 0;
+  for (int y = 0; y < grid_numrows(grid); ++y){
+    for (int x = 0; x < grid_numcols(grid); ++x){
+      char c = grid_charAt(grid, x, y);
+      if (c != mapchars_roomSpot && c != mapchars_gold){
+        continue;
+      }
+
+      grid_useRoomIndex(true);
+      grid_t* indexed = grid_generateVisibleGrid(grid, NULL, x, y);
+      grid_useRoomIndex(false);
+      grid_t* traced = grid_generateVisibleGrid(grid, NULL, x, y);
+      if (!grid_viewEquals(grid, indexed, traced)){
+        ++numMismatches;
+      }
+      ++numSpots;
+
+      grid_delete(indexed);
+      grid_delete(traced);
+    }
+  }
+  grid_useRoomIndex(true);
+  printf("%d room spots, %d mismatches\n", numSpots, numMismatches);
+
+  // from every spot a player can stand on, culling tiles must not change
+  // what is seen, or which tiles it is seen in
+  printf("Checking tile culling against testing every cell\n");
+  numSpots = 0;
+  numMismatches = 0;
+  for (int y = 0; y < grid_numrows(grid); ++y){
+    for (int x = 0; x < grid_numcols(grid); ++x){
+      char c = grid_charAt(grid, x, y);
+      if (c != mapchars_roomSpot && c != mapchars_gold
+                                 && c != mapchars_passageSpot){
+        continue;
+      }
+
+      grid_useTileCulling(true);
+      grid_t* culled = grid_generateVisibleGrid(grid, NULL, x, y);
+      grid_useTileCulling(false);
+      grid_t* unculled = grid_generateVisibleGrid(grid, NULL, x, y);
+      bool same = grid_viewEquals(grid, culled, unculled);
+      for (int tile = 0; tile < grid_numTiles(grid); ++tile){
+        same = same && grid_seesTile(culled, tile) == grid_seesTile(unculled, tile);
+      }
+      if (!same){
+        ++numMismatches;
+      }
+      ++numSpots;
+
+      grid_delete(culled);
+      grid_delete(unculled);
+    }
+  }
+  grid_useTileCulling(true);
+  printf("%d spots, %d mismatches\n", numSpots, numMismatches);
+
   grid_delete(grid);
   grid_delete(visibleGrid);
+  grid_delete(refreshedGrid);
+  grid_delete(fullGrid);
+  free(display);
 }
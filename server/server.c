@@ -4,7 +4,10 @@
  * Launches the server for the Nuggets game. 
  * The server manages all messaging and game logic to all the clients.
  *
- * Usage: server map.txt [seed]
+ * Usage: server map.txt [seed] [radius]
+ *
+ * With a radius, players only see that many cells away; handy for
+ * keeping moves cheap on very large maps. The default is no limit.
  *
  * Author: TEAM TORPEDOS - Sam Starrs, March 2024
  *
@@ -22,12 +25,13 @@
 #include "message.h"
 #include "set.h"
 #include "grid.h"
+#include "arena.h"
 #include "mem.h"
 
 /**************** local functions ****************/
 /* not visible outside this file */
 static void parseArgs(const int argc, char* argv[],
-                      FILE** map, int* seed);
+                      FILE** map, int* seed, int* radius);
 static bool handleMessage(void* arg, const addr_t from, const char* buf);
 static void handlePlay(void* arg, const addr_t from, const char* content);
 static bool  handleKey(void* arg, const addr_t from, const char* content);
@@ -49,12 +53,13 @@ int main(const int argc, char* argv[]) {
     // Create variables
     FILE* map = NULL;
     int seed;
+    int radius;
 
     // Parse arguments, open map and set seed
-    parseArgs(argc, argv, &map, &seed);
+    parseArgs(argc, argv, &map, &seed, &radius);
 
     // Intialize game
-    game = game_init(map);
+    game = game_init(map, radius);
 
     // Check if successful
     if (game == NULL) {
@@ -70,11 +75,17 @@ int main(const int argc, char* argv[]) {
         return 2;
     } else {
         printf("serverPort=%d\n", port);
+        fflush(stdout); // scripts wait for this line before connecting
     }
 
     // Loop through messages and return 0 or 1
     bool ok = message_loop(NULL, 0, NULL, NULL, handleMessage);
     message_done();
+
+    // Where the allocations made through mem_ happened, phase by phase;
+    // grid calls malloc directly (see grid.c), so is not counted
+    fprintf(stderr, "mem_ allocations by phase (direct malloc calls not counted):\n");
+    mem_phaseReport(stderr);
     return ok? 0 : 1;
 
 }
@@ -85,10 +96,10 @@ int main(const int argc, char* argv[]) {
  * Adapted from parseArgs.c on CS50 Github
  */
 static void parseArgs(const int argc, char* argv[],
-                      FILE** map, int* seed) {
+                      FILE** map, int* seed, int* radius) {
 
-    // Should only be 2 or 3 arguments
-    if (argc == 2 || argc == 3){
+    // Should only be 2, 3 or 4 arguments
+    if (argc >= 2 && argc <= 4){
 
         char* mapString = argv[1];
 
@@ -98,7 +109,7 @@ static void parseArgs(const int argc, char* argv[],
         }
 
         // If there is indeed a 3rd argument, set up seed
-        if (argc == 3) {
+        if (argc >= 3) {
             char* seedString = argv[2];
             // Try to convert seedString to an int
             *seed = 0; // initialize calling function's value
@@ -121,9 +132,26 @@ static void parseArgs(const int argc, char* argv[],
             srand(getpid());
         }
 
+        // If there is a 4th argument, it limits how far players can see
+        *radius = 0;
+        if (argc == 4) {
+            char* radiusString = argv[3];
+            char excess; // any excess chars after the number
+
+            if (sscanf(radiusString, "%d%c", radius, &excess) != 1) {
+                fprintf(stderr, "ERROR: '%s' invalid integer\n", radiusString);
+                exit(4);
+            }
+
+            if (*radius < 0) {
+                fprintf(stderr, "ERROR: '%d' must be >= 0\n", *radius);
+                exit(5);
+            }
+        }
+
     // If there are an unacceptable number of arguments
     } else {
-        fprintf(stderr, "USAGE: server map.txt [seed]\n");
+        fprintf(stderr, "USAGE: server map.txt [seed] [radius]\n");
         exit(1);
     }
 
@@ -139,18 +167,32 @@ static bool handleMessage(void* arg, const addr_t from, const char* message) {
 
     bool gameOver = false;
 
+    // Anything allocated while handling the last message is done with
+    game_resetScratch(game);
+
     // PLAY message - SYNTAX: PLAY real name
     if (strncmp(message, "PLAY ", strlen("PLAY ")) == 0) {
         const char* content = message + strlen("PLAY ");
+        mem_phasePush("join");
         handlePlay(arg, from, content);
-    // KEY message - SYNTAX: KEY k
+        mem_phasePop();
+    // KEY message - SYNTAX: KEY k [seq]
     } else if (strncmp(message, "KEY ", strlen("KEY ")) == 0) {
         const char* content = message + strlen("KEY ");
+        mem_phasePush("key");
         gameOver = handleKey(arg, from, content);
+        mem_phasePop();
     // SPECTATE message - SYNTAX: SPECTATE
     } else if (strncmp(message, "SPECTATE", strlen("SPECTATE")) == 0) {
         const char* content = message + strlen("SPECTATE");
+        mem_phasePush("join");
         handleSpectate(arg, from, content);
+        mem_phasePop();
+    // MODE message - SYNTAX: MODE DELTA
+    } else if (strcmp(message, "MODE DELTA") == 0) {
+        mem_phasePush("mode");
+        game_setDeltaMode(game, from);
+        mem_phasePop();
     } 
 
     return gameOver;
@@ -174,52 +216,40 @@ static void handlePlay(void* arg, const addr_t from, const char* content) {
             grid_findRandomSpawnPosition(game_masterGrid(game), &x, &y);
             char playerLetter = 'A' + game_numPlayers(game);
             char* name = fixName(content);
-            player_t* player = player_new(from, x, y, name, playerLetter);
+            player_t* player = player_new(game_getPlayers(game), from, x, y, name, playerLetter);
             game_addPlayer(game, player);
 
             // Send OK message
-            char* okMessage = mem_malloc((sizeof(char) * strlen("OK A")) + 1);
+            char* okMessage = arena_alloc(game_scratch(game), (sizeof(char) * strlen("OK A")) + 1);
             sprintf(okMessage, "OK %c", playerLetter);
             message_send(from, okMessage);
-            mem_free(okMessage);
 
             // Send GRID message
             int nrows = grid_numrows(game_masterGrid(game));
             int ncols = grid_numcols(game_masterGrid(game));
             int rowsDigitLength = snprintf(NULL, 0, "%d", nrows);
             int colsDigitLength = snprintf(NULL, 0, "%d", ncols);
-            char* gridMessage = mem_malloc((sizeof(char) * strlen("GRID 1 1")) + rowsDigitLength + colsDigitLength + 1);
+            char* gridMessage = arena_alloc(game_scratch(game), (sizeof(char) * strlen("GRID 1 1")) + rowsDigitLength + colsDigitLength + 1);
             sprintf(gridMessage, "GRID %d %d", nrows, ncols);
             message_send(from, gridMessage);
-            mem_free(gridMessage);
 
             // Send GOLD message
             int r = game_getGold(game);
             int digitLength = snprintf(NULL, 0, "%d", r);
-            char* goldMessage = mem_malloc((sizeof(char) * strlen("GOLD 1 1 1")) + digitLength + 1);
+            char* goldMessage = arena_alloc(game_scratch(game), (sizeof(char) * strlen("GOLD 1 1 1")) + digitLength + 1);
             sprintf(goldMessage, "GOLD 0 0 %d", r);
             message_send(from, goldMessage);
-            mem_free(goldMessage);
 
             // Send DISPLAY message
-            player_updateVisibleGrid(player, game_masterGrid(game));
-            char* string = grid_getDisplay(player_getVisibleGrid(player));
-            char* displayMessage = mem_malloc((sizeof(char) * (strlen("DISPLAY\n") + strlen(string))) + 1);
-            sprintf(displayMessage, "DISPLAY\n%s", string);
-            message_send(from, displayMessage);
-            mem_free(displayMessage);
-            mem_free(string);
+            grid_t* masterGrid = game_masterGrid(game);
+            char* display = arena_alloc(game_scratch(game), grid_displayLength(masterGrid) + 1);
+            player_updateVisibleGrid(player, masterGrid);
+            player_sendDisplay(player, grid_composeView(masterGrid, player_getVisibleGrid(player), display));
 
             // Also send DISPLAY message to SPECTATOR if SPECTATOR exists
             spectator_t* spectator;
             if ((spectator = game_getSpectator(game)) != NULL) {
-                addr_t to = spectator_getAddress(spectator);
-                char* spectatorString = grid_getDisplay(game_masterGrid(game));
-                char* spectatorDisplayMessage = mem_malloc((sizeof(char) * (strlen("DISPLAY\n") + strlen(spectatorString))) + 1);
-                sprintf(spectatorDisplayMessage, "DISPLAY\n%s", spectatorString);
-                message_send(to, spectatorDisplayMessage);
-                mem_free(spectatorDisplayMessage);
-                mem_free(spectatorString);
+                spectator_sendDisplay(spectator, grid_displayView(game_masterGrid(game)));
             }
 
         } else {
@@ -241,6 +271,14 @@ static bool handleKey(void* arg, const addr_t from, const char* content) {
 
   bool gameOver = false;
 
+    // KEY k seq: echo seq, with the server's times, in what it causes
+    unsigned long seq;
+    bool traced = content != NULL && content[0] != '\0'
+                  && sscanf(content + 1, " %lu", &seq) == 1;
+    if (traced) {
+        game_traceKey(game, from, seq);
+    }
+
     // Go through each key case if a key was given
     if(content != NULL) {
         char letter = content[0];
@@ -266,6 +304,9 @@ static bool handleKey(void* arg, const addr_t from, const char* content) {
             default: errorMessage(from, content); // key not recognized
         }
     }
+    if (traced && !gameOver) {   // game over frees the game
+        game_endTrace(game);
+    }
     return gameOver;
 }
 
@@ -284,26 +325,19 @@ static void handleSpectate(void* arg, const addr_t from, const char* content) {
     int ncols = grid_numcols(game_masterGrid(game));
     int rowsDigitLength = snprintf(NULL, 0, "%d", nrows);
     int colsDigitLength = snprintf(NULL, 0, "%d", ncols);
-    char* gridMessage = mem_malloc((sizeof(char) * strlen("GRID 1 1")) + rowsDigitLength + colsDigitLength + 1);
+    char* gridMessage = arena_alloc(game_scratch(game), (sizeof(char) * strlen("GRID 1 1")) + rowsDigitLength + colsDigitLength + 1);
     sprintf(gridMessage, "GRID %d %d", nrows, ncols);
     message_send(from, gridMessage);
-    mem_free(gridMessage);
 
     // Send GOLD message
     int r = game_getGold(game);
     int digitLength = snprintf(NULL, 0, "%d", r);
-    char* goldMessage = mem_malloc((sizeof(char) * strlen("GOLD 1 1 1")) + digitLength + 1);
+    char* goldMessage = arena_alloc(game_scratch(game), (sizeof(char) * strlen("GOLD 1 1 1")) + digitLength + 1);
     sprintf(goldMessage, "GOLD 0 0 %d", r);
     message_send(from, goldMessage);
-    mem_free(goldMessage);
 
     // Send DISPLAY message
-    char* string = grid_getDisplay(game_masterGrid(game));
-    char* displayMessage = mem_malloc((sizeof(char) * (strlen("DISPLAY\n") + strlen(string))) + 1);
-    sprintf(displayMessage, "DISPLAY\n%s", string);
-    message_send(from, displayMessage);
-    mem_free(displayMessage);
-    mem_free(string);
+    spectator_sendDisplay(game_getSpectator(game), grid_displayView(game_masterGrid(game)));
 
 }
 
@@ -334,10 +368,9 @@ static void keyQ(const addr_t from) {
 static void errorMessage(const addr_t from, const char* content) {
 
     // Create error message for when key isn't recognized
-    char* errorMsg = malloc((sizeof(char) * (strlen("ERROR - key ' ' not recognized")) + strlen(content)) + 1);
+    char* errorMsg = arena_alloc(game_scratch(game), (sizeof(char) * (strlen("ERROR - key ' ' not recognized")) + strlen(content)) + 1);
     sprintf(errorMsg, "ERROR - key '%s' not recognized", content);
     message_send(from, errorMsg);
-    free(errorMsg);
 
 }
 
@@ -362,11 +395,12 @@ static bool checkWhitespace(const char* name){
 /* Takes a string.
  * Truncates string based on max name length and replaces
  * with underscores 
- * User must free the produced string!
+ * The produced string is in the scratch arena, so is only
+ * good until the next message.
  */
 static char* fixName(const char* entry) {
 
-    char* name = mem_malloc(MAXNAMELENGTH+1);
+    char* name = arena_alloc(game_scratch(game), MAXNAMELENGTH+1);
     // If the entry is less than the max name length
     if (strlen(entry) < MAXNAMELENGTH) {
         for (int i = 0; entry[i] != '\0'; i++) {
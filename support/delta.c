@@ -0,0 +1,169 @@
+/*
+ * delta - writing and reading the frames a nuggets server sends
+ *
+ * See delta.h for detailed interface description for each function.
+ *
+ * Ribhu Hooja, March 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "delta.h"
+
+/**************** file-local constants ****************/
+static const int MergeGap = 8;  // unchanged cells a DELTA run may span
+
+/**************** delta_encode ****************/
+/*
+ * Find the runs of changed cells in each row that changed, joining runs
+ * close together, and send the whole row instead if that is shorter.
+ * See delta.h for detailed description.
+ */
+int
+delta_encode(const char* display, char* lastSent, const int rows,
+             const int cols, char* out)
+{
+  char* end = out;
+  for (int y = 0; y < rows; y++) {
+    const char* now = display + y * (cols + 1);
+    char* was = lastSent + y * (cols + 1);
+    if (memcmp(now, was, cols) == 0) {
+      continue;
+    }
+
+    char* rowStart = end;
+    int x = 0;
+    while (x < cols) {
+      if (now[x] == was[x]) {
+        x++;
+        continue;
+      }
+
+      // the run goes on until MergeGap cells in a row are unchanged
+      int first = x;
+      int last = x;
+      for (int i = x + 1; i < cols && i - last <= MergeGap; i++) {
+        if (now[i] != was[i]) {
+          last = i;
+        }
+      }
+      end += sprintf(end, "%d %d ", y, first);
+      memcpy(end, now + first, last - first + 1);
+      end += last - first + 1;
+      *end++ = '\n';
+      x = last + 1;
+    }
+
+    // lots of little runs cost more than the whole row
+    int wholeRow = snprintf(NULL, 0, "%d 0 ", y) + cols + 1;
+    if (end - rowStart > wholeRow) {
+      end = rowStart + sprintf(rowStart, "%d 0 ", y);
+      memcpy(end, now, cols);
+      end += cols;
+      *end++ = '\n';
+    }
+
+    memcpy(was, now, cols);
+  }
+
+  *end = '\0';
+  return end - out;
+}
+
+/**************** delta_blank ****************/
+/*
+ * Fill the map with spaces, ending each row with a newline.
+ * See delta.h for detailed description.
+ */
+void
+delta_blank(char* map, const int rows, const int cols)
+{
+  int length = rows * (cols + 1);
+  memset(map, ' ', length);
+  for (int y = 0; y < rows; y++) {
+    map[y * (cols + 1) + cols] = '\n';
+  }
+  map[length] = '\0';
+}
+
+/**************** delta_apply ****************/
+/*
+ * Copy each text into the map at its row, from its column,
+ * stopping at the end of the row.
+ * See delta.h for detailed description.
+ */
+bool
+delta_apply(char* map, const int rows, const int cols, const char* lines)
+{
+  const char* line = lines;
+  while (*line != '\0') {
+    char* rest;
+    long row = strtol(line, &rest, 10);
+    if (rest == line || *rest != ' ') {
+      return false;
+    }
+    line = rest + 1;
+    long col = strtol(line, &rest, 10);
+    if (rest == line || *rest != ' ') {
+      return false;
+    }
+    line = rest + 1;
+    if (row < 0 || row >= rows || col < 0 || col >= cols) {
+      return false;
+    }
+
+    // the text runs to the end of the line
+    char* cell = map + row * (cols + 1) + col;
+    for (long x = col; *line != '\n' && *line != '\0'; x++, line++) {
+      if (x < cols) {
+        *cell++ = *line;
+      }
+    }
+    if (*line == '\n') {
+      line++;
+    }
+  }
+  return true;
+}
+
+/**************** delta_parseTrace ****************/
+/*
+ * Match the first line of the message against each kind of frame
+ * that can carry a trace, with the trace at its very end.
+ * See delta.h for detailed description.
+ */
+bool
+delta_parseTrace(const char* message, unsigned long* seq,
+                 long long* received, long long* sent)
+{
+  // only the first line
+  char line[128];
+  const char* end = strchr(message, '\n');
+  size_t length = end == NULL ? strlen(message) : (size_t) (end - message);
+  if (length >= sizeof(line)) {
+    return false;
+  }
+  memcpy(line, message, length);
+  line[length] = '\0';
+
+  unsigned long s;
+  long long r, t;
+  int n, p, g;
+  unsigned int number;
+  int used = 0;
+  bool traced =
+    (sscanf(line, "DISPLAY %lu %lld %lld%n", &s, &r, &t, &used) == 3
+     || sscanf(line, "DELTA %u %lu %lld %lld%n", &number, &s, &r, &t, &used) == 4
+     || sscanf(line, "GOLD %d %d %d %lu %lld %lld%n", &n, &p, &g, &s, &r, &t, &used) == 6)
+    && line[used] == '\0';
+  if (!traced) {
+    return false;
+  }
+
+  *seq = s;
+  *received = r;
+  *sent = t;
+  return true;
+}
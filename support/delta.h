@@ -0,0 +1,86 @@
+/*
+ * delta - writing and reading the frames a nuggets server sends
+ *
+ * A client that sends MODE DELTA is sent, instead of each DISPLAY, a
+ *   DELTA n
+ *   row col text
+ *   ...
+ * where each text replaces the cells of that row of the map from col on.
+ * DELTA 1 applies to a blank map, and each later one to the map the one
+ * before it left.
+ *
+ * A client that sends KEY k seq has " seq received sent" added to the
+ * first line of the DISPLAY, DELTA and GOLD that KEY causes for it, where
+ * received and sent are the server's clock, in microseconds.
+ *
+ * The server writes DELTAs, and the client and the bot read frames, with
+ * this module.
+ *
+ * Ribhu Hooja, March 2024
+ */
+
+#ifndef _DELTA_H_
+#define _DELTA_H_
+
+#include <stdbool.h>
+
+/****************** global functions *********************/
+
+/******************************************/
+/* delta_encode: write the lines of a DELTA from one map to the next.
+ * Caller provides:
+ *   the new map, as in a DISPLAY,
+ *   the map the recipient has now, which is then made the same as the new,
+ *   the number of rows and columns of the maps,
+ *   room for the lines; about twice the length of a map is always enough.
+ * Function returns:
+ *   the length of the lines written, which is 0 if nothing changed.
+ * Notes:
+ *   Runs of changes fewer than 8 unchanged cells apart are sent as one
+ *   line, unchanged cells and all. A row that would take more than one
+ *   line holding the whole row is sent as that line.
+ */
+int delta_encode(const char* display, char* lastSent, const int rows,
+                 const int cols, char* out);
+
+/******************************************/
+/* delta_blank: make a blank map, for DELTA 1 to apply to.
+ * Caller provides:
+ *   room for the map, rows * (cols + 1) + 1 characters,
+ *   the number of rows and columns of the map.
+ * Function returns: nothing.
+ * Notes:
+ *   A blank map is all spaces, with a newline at the end of each row,
+ *   like the map in a DISPLAY.
+ */
+void delta_blank(char* map, const int rows, const int cols);
+
+/******************************************/
+/* delta_apply: apply the lines of a DELTA to a map.
+ * Caller provides:
+ *   a map, as made by delta_blank or sent in a DISPLAY,
+ *   the number of rows and columns of the map,
+ *   the lines of the DELTA, after its first line.
+ * Function returns:
+ *   true if every line was "row col text", with row and col in the map;
+ *   false if not, leaving the lines before the bad one applied.
+ * Notes:
+ *   Text that runs past the end of its row is cut off there.
+ */
+bool delta_apply(char* map, const int rows, const int cols, const char* lines);
+
+/******************************************/
+/* delta_parseTrace: read the echo of a traced KEY from a message.
+ * Caller provides:
+ *   a message from the server,
+ *   where to put the KEY's seq, and when the server received the KEY and
+ *   sent this message, in microseconds by the server's clock.
+ * Function returns:
+ *   true if the first line of the message is a DISPLAY, DELTA or GOLD
+ *   ending with " seq received sent";
+ *   false otherwise, leaving the three untouched.
+ */
+bool delta_parseTrace(const char* message, unsigned long* seq,
+                      long long* received, long long* sent);
+
+#endif // _DELTA_H_
@@ -23,6 +23,8 @@
 #include <netdb.h>
 #include <arpa/inet.h>
 #include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 #include <math.h>
 #include "message.h"
 #include "log.h"
@@ -191,7 +193,8 @@ message_setAddr(const char* hostname, const char* portString, addr_t* addr)
 /**************** message_stringAddr ****************/
 /* Produce a string representation of the address.
  * Returns pointer to static storage that should not be retained
- * (because every call to this function returns the same pointer).
+ * (because every call to this function from a thread returns the same
+ * pointer); each thread has its own, so threads can log at once.
  * See message.h for detailed description.
  */
 const char*
@@ -199,10 +202,11 @@ message_stringAddr(const addr_t addr)
 {
   // Maximum string length to hold an IP address and port, plus null.
   // e.g., 255.255.255.255:65507
-  static char addrString[22]; // constant appears in snprintf below
+  static _Thread_local char addrString[22]; // constant appears in snprintf below
+  char host[INET_ADDRSTRLEN];
 
   snprintf(addrString, 22, "%s:%05d",
-	   inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
+	   inet_ntop(AF_INET, &addr.sin_addr, host, sizeof(host)), ntohs(addr.sin_port));
 
   return addrString;
 }
@@ -256,13 +260,57 @@ message_send(const addr_t to, const char* message)
   if (sendto(ourSocket, message, strlen(message), 0,
              (struct sockaddr *) &to, sizeof(to)) < 0) {
     log_e("message_send: error sending to datagram socket");
-  } else {
+  } else if (logFP != NULL) {
+    // the address is only formatted if it is logged; pool threads send
+    // at once, each into its own buffer (see message_stringAddr)
     log_s("message_send: TO %s", message_stringAddr(to));
     log_d("message_send: %d lines:", numLines(message));
     log_s("%s", message);
   }
 }
 
+/**************** message_sendParts ****************/
+/* 
+ * Send a two-part message to the correspondent address, handing both
+ * parts straight to the kernel with one sendmsg.
+ * See message.h for detailed description.
+ */
+void
+message_sendParts(const addr_t to, const char* header, const char* body)
+{
+  if (ourSocket == 0) {
+    log_v("message_sendParts: called before message_init");
+    return; // error in usage of this function.
+  }
+  if (header == NULL || body == NULL) {
+    log_v("message_sendParts: called with null message");
+    return; // error in usage of this function.
+  }
+
+  struct iovec parts[2];
+  parts[0].iov_base = (void*) header;
+  parts[0].iov_len = strlen(header);
+  parts[1].iov_base = (void*) body;
+  parts[1].iov_len = strlen(body);
+
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_name = (void*) &to;
+  msg.msg_namelen = sizeof(to);
+  msg.msg_iov = parts;
+  msg.msg_iovlen = 2;
+
+  if (sendmsg(ourSocket, &msg, 0) < 0) {
+    log_e("message_sendParts: error sending to datagram socket");
+  } else if (logFP != NULL) {
+    // as in message_send, only format the address to log it
+    log_s("message_sendParts: TO %s", message_stringAddr(to));
+    log_d("message_sendParts: %d lines:", numLines(header) + numLines(body));
+    log_s("%s", header);
+    log_s("%s", body);
+  }
+}
+
 /**************** message_loop ****************/
 /* 
  * Loop forever, calling handler functions for stdin or socket,
@@ -303,7 +351,7 @@ message_loop(void* arg, const float timeout,
   struct timeval  timeoutval;     // timeval equivalent of parameter 'timeout'
   if (timeout > 0.0) {
     timeoutval.tv_sec  = (int)timeout;
-    timeoutval.tv_usec = timeout - (int)timeout;
+    timeoutval.tv_usec = (timeout - (int)timeout) * 1000000;
   }
 
   // loop until error or some handler indicates time to quit looping
@@ -378,10 +426,12 @@ message_loop(void* arg, const float timeout,
             // ignore it
             log_d("message_loop: non-Internet family %d\n", sender.sin_family);
           } else {
-	    // record it
-	    log_s("message_loop: FROM %s", message_stringAddr(sender));
-	    log_d("message_loop: %d lines:", numLines(buf));
-	    log_s("%s", buf);
+	    // record it, if logging
+	    if (logFP != NULL) {
+	      log_s("message_loop: FROM %s", message_stringAddr(sender));
+	      log_d("message_loop: %d lines:", numLines(buf));
+	      log_s("%s", buf);
+	    }
 
             // handle it
             if (handleMessage != NULL && (*handleMessage)(arg, sender, buf)) {
@@ -395,6 +445,26 @@ message_loop(void* arg, const float timeout,
   return true;
 }
 
+/**************** message_isPending ****************/
+/* 
+ * Says whether a message is waiting to be received, without waiting.
+ * See message.h for detailed description.
+ */
+bool
+message_isPending(void)
+{
+  if (ourSocket == 0) {
+    return false;
+  }
+
+  // poll the socket: select() with a zero timeout returns at once
+  fd_set rfds;
+  FD_ZERO(&rfds);
+  FD_SET(ourSocket, &rfds);
+  struct timeval zero = {0, 0};
+  return select(ourSocket+1, &rfds, NULL, NULL, &zero) > 0;
+}
+
 /**************** message_done ****************/
 /* 
  * Clean up the message module, prior to exit.
@@ -115,6 +115,7 @@ bool message_setAddr(const char* hostname, const char* portStr, addr_t* addr);
  * Returns:
  *   a string representation of the address,
  *   which is a pointer to static storage that cannot be retained!
+ *   (each thread has its own)
  * Logs:
  *   nothing.
  */
@@ -127,12 +128,33 @@ const char* message_stringAddr(const addr_t addr);
  *   a string containing the message.
  * Function returns: none
  * Assumptions: message_init() has already been called.
+ * Notes:
+ *   Several threads may send at once, e.g. the server's pool threads.
  * Logs:
  *   errors in arguments,
  *   errors in sending the message.
  */
 void message_send(const addr_t to, const char* message);
 
+/******************************************/
+/* message_sendParts: send a message made of two parts, without first 
+ * copying them into one buffer.
+ * Caller provides:
+ *   a valid address to which to send the message,
+ *   a string containing the first part of the message (e.g., a header),
+ *   a string containing the rest of the message (e.g., a body).
+ * Function returns: none
+ * Assumptions: message_init() has already been called.
+ * Notes:
+ *   The two parts go out as one message; the receiver cannot tell it
+ *   from message_send() of the two strings concatenated.
+ *   Several threads may send at once, as with message_send().
+ * Logs:
+ *   errors in arguments,
+ *   errors in sending the message.
+ */
+void message_sendParts(const addr_t to, const char* header, const char* body);
+
 /******************************************/
 /* message_loop: loop, handling input and incoming messages.
  * Caller provides:
@@ -166,6 +188,19 @@ bool message_loop(void* arg, const float timeout,
                                         const addr_t from, 
                                         const char* message));
 
+/******************************************/
+/* message_isPending: is a message waiting to be received?
+ * Caller provides: nothing.
+ * Function returns:
+ *   true if a message has arrived that message_loop has not yet handled,
+ *   false if not (or the module is not initialized).
+ * Notes:
+ *   Never waits. A handler can use this to put off work, such as redrawing
+ *   the screen, until it has seen every message that has arrived so far.
+ * Logs: nothing.
+ */
+bool message_isPending(void);
+
 /******************************************/
 /* message_done: shut down the module.
  * Caller provides: nothing.